@@ -1,15 +1,36 @@
+build/atlas.o: src/atlas.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/atlas.c
+build/cache.o: src/cache.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/cache.c
+build/chunkdict.o: src/chunkdict.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/chunkdict.c
 build/client.o: src/client.c src/*.h
 	@$(MK_BUILD_DIR)
 	$(CC) $(CFLAGS) -o $@ -c src/client.c
+build/codec.o: src/codec.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/codec.c
 build/cube.o: src/cube.c src/*.h
 	@$(MK_BUILD_DIR)
 	$(CC) $(CFLAGS) -o $@ -c src/cube.c
+build/cull.o: src/cull.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/cull.c
+build/glstate.o: src/glstate.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/glstate.c
 build/item.o: src/item.c src/*.h
 	@$(MK_BUILD_DIR)
 	$(CC) $(CFLAGS) -o $@ -c src/item.c
 build/lodepng.o: src/lodepng.c src/*.h
 	@$(MK_BUILD_DIR)
 	$(CC) $(CFLAGS) -o $@ -c src/lodepng.c
+build/lz.o: src/lz.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/lz.c
 build/main.o: src/main.c src/*.h
 	@$(MK_BUILD_DIR)
 	$(CC) $(CFLAGS) -o $@ -c src/main.c
@@ -22,9 +43,21 @@ build/matrix.o: src/matrix.c src/*.h
 build/miniz.o: src/miniz.c src/*.h
 	@$(MK_BUILD_DIR)
 	$(CC) $(CFLAGS) -o $@ -c src/miniz.c
+build/pool.o: src/pool.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/pool.c
+build/profile.o: src/profile.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/profile.c
+build/progcache.o: src/progcache.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/progcache.c
 build/tinycthread.o: src/tinycthread.c src/*.h
 	@$(MK_BUILD_DIR)
 	$(CC) $(CFLAGS) -o $@ -c src/tinycthread.c
+build/trace.o: src/trace.c src/*.h
+	@$(MK_BUILD_DIR)
+	$(CC) $(CFLAGS) -o $@ -c src/trace.c
 build/util.o: src/util.c src/*.h
 	@$(MK_BUILD_DIR)
 	$(CC) $(CFLAGS) -o $@ -c src/util.c
@@ -1 +1 @@
-OBJECT_FILES = build/client.o build/cube.o build/item.o build/lodepng.o build/main.o build/map.o build/matrix.o build/miniz.o build/tinycthread.o build/util.o
\ No newline at end of file
+OBJECT_FILES = build/atlas.o build/cache.o build/chunkdict.o build/client.o build/codec.o build/cube.o build/cull.o build/glstate.o build/item.o build/lodepng.o build/lz.o build/main.o build/map.o build/matrix.o build/miniz.o build/pool.o build/profile.o build/progcache.o build/tinycthread.o build/trace.o build/util.o
\ No newline at end of file
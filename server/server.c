@@ -0,0 +1,674 @@
+/* A minimal stand-in for craft-server, for load testing the client.
+ *
+ *     craft-server [-p PORT] [-b BOTS] [-m MOVES] [-e EDITS]
+ *
+ * Terrain is generated on demand and only edited chunks are kept. Each of
+ * the BOTS scripted players walks in circles, sending MOVES position
+ * updates and EDITS block changes per second; a tick's changes to one
+ * chunk go out as a single R delta. */
+
+#define _POSIX_C_SOURCE 200809L
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "client.h"
+#include "codec.h"
+#include "config.h"
+#include "item.h"
+#include "lz.h"
+#include "world.h"
+
+#define MAX_CLIENTS 256
+#define MAX_BOTS 1024
+#define MAX_MESSAGE 1024
+#define MAX_OUTPUT (64 * 1024 * 1024)
+#define MAX_EDITS 65536
+#define MAX_RUNS 8192
+#define TICK_RATE 20
+#define DAY_LENGTH 600
+#define VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+typedef struct {
+    int p;
+    int q;
+    int r;
+    unsigned int version;
+    unsigned char ws[VOLUME];
+} Chunk;
+
+typedef struct {
+    int fd;
+    int id;
+    int codec;
+    char name[32];
+    float x, y, z, rx, ry;
+    char input[MAX_MESSAGE + 4];
+    int input_length;
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+} Client;
+
+typedef struct {
+    int id;
+    float cx, cz;
+    float radius;
+    float angle;
+    float speed;
+    float x, y, z, rx, ry;
+    double move_debt;
+    double edit_debt;
+} Bot;
+
+typedef struct {
+    int p, q, r;
+    int index;
+    int w;
+    unsigned int sequence;
+} Edit;
+
+typedef struct {
+    Chunk **chunks;
+    unsigned int mask;
+    unsigned int count;
+} World;
+
+static World world;
+static Client clients[MAX_CLIENTS];
+static int client_count = 0;
+static Bot bots[MAX_BOTS];
+static int bot_count = 0;
+static Edit edits[MAX_EDITS];
+static int edit_count = 0;
+static unsigned int edit_sequence = 0;
+static int next_id = 1;
+static double start_time;
+static long chunks_sent = 0;
+static long bytes_sent = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int chunked(float x) {
+    return floorf(x / CHUNK_SIZE);
+}
+
+static int mod_euc(int a, int m) {
+    return (a % m + m) % m;
+}
+
+static unsigned int chunk_hash(int p, int q, int r) {
+    unsigned int h = p * 73856093u ^ q * 19349663u ^ r * 83492791u;
+    h = ((h >> 16) ^ h) * 0x45d9f3b;
+    return (h >> 16) ^ h;
+}
+
+/* edited chunks; everything else is regenerated on request */
+static Chunk *find_chunk(int p, int q, int r) {
+    if (!world.chunks) {
+        return 0;
+    }
+    for (unsigned int i = chunk_hash(p, q, r) & world.mask;
+        world.chunks[i]; i = (i + 1) & world.mask)
+    {
+        Chunk *chunk = world.chunks[i];
+        if (chunk->p == p && chunk->q == q && chunk->r == r) {
+            return chunk;
+        }
+    }
+    return 0;
+}
+
+static void insert_chunk(Chunk *chunk) {
+    unsigned int i = chunk_hash(chunk->p, chunk->q, chunk->r) & world.mask;
+    while (world.chunks[i]) {
+        i = (i + 1) & world.mask;
+    }
+    world.chunks[i] = chunk;
+}
+
+static Chunk *edit_chunk(int p, int q, int r) {
+    Chunk *chunk = find_chunk(p, q, r);
+    if (chunk) {
+        return chunk;
+    }
+    if (!world.chunks || world.count * 2 >= world.mask) {
+        Chunk **old = world.chunks;
+        unsigned int old_size = old ? world.mask + 1 : 0;
+        world.mask = old ? world.mask * 2 + 1 : 255;
+        world.chunks = calloc(world.mask + 1, sizeof(Chunk *));
+        for (unsigned int i = 0; i < old_size; i++) {
+            if (old[i]) {
+                insert_chunk(old[i]);
+            }
+        }
+        free(old);
+    }
+    chunk = malloc(sizeof(Chunk));
+    chunk->p = p;
+    chunk->q = q;
+    chunk->r = r;
+    chunk->version = 1;
+    world_generate(chunk->ws, p, q, r);
+    insert_chunk(chunk);
+    world.count++;
+    return chunk;
+}
+
+static int get_block(int x, int y, int z) {
+    int p = chunked(x), q = chunked(y), r = chunked(z);
+    int index = mod_euc(x, CHUNK_SIZE) + mod_euc(y, CHUNK_SIZE) * CHUNK_SIZE +
+        mod_euc(z, CHUNK_SIZE) * CHUNK_SIZE * CHUNK_SIZE;
+    Chunk *chunk = find_chunk(p, q, r);
+    if (chunk) {
+        return chunk->ws[index];
+    }
+    static unsigned char ws[VOLUME];
+    world_generate(ws, p, q, r);
+    return ws[index];
+}
+
+static void set_block(int x, int y, int z, int w) {
+    Chunk *chunk = edit_chunk(chunked(x), chunked(y), chunked(z));
+    int index = mod_euc(x, CHUNK_SIZE) + mod_euc(y, CHUNK_SIZE) * CHUNK_SIZE +
+        mod_euc(z, CHUNK_SIZE) * CHUNK_SIZE * CHUNK_SIZE;
+    if (chunk->ws[index] != w) {
+        chunk->ws[index] = w;
+        chunk->version++;
+    }
+}
+
+static void write_int64(unsigned char *data, int64_t value) {
+    for (int i = 0; i < 8; i++) {
+        data[i] = (uint64_t)value >> (56 - i * 8);
+    }
+}
+
+static void write_int32(unsigned char *data, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        data[i] = value >> (24 - i * 8);
+    }
+}
+
+static void client_free(Client *client) {
+    close(client->fd);
+    free(client->output);
+}
+
+static void queue_data(Client *client, const void *data, size_t size) {
+    if (client->fd < 0) {
+        return;
+    }
+    size_t needed = client->output_length + size + 4;
+    if (needed > MAX_OUTPUT) {
+        fprintf(stderr, "client %d too slow, dropping\n", client->id);
+        client_free(client);
+        client->fd = -1;
+        return;
+    }
+    if (needed > client->output_capacity) {
+        client->output_capacity = MAX(needed, client->output_capacity * 2);
+        client->output = realloc(client->output, client->output_capacity);
+    }
+    uint32_t length = htonl(size);
+    memcpy(client->output + client->output_length, &length, 4);
+    memcpy(client->output + client->output_length + 4, data, size);
+    client->output_length += size + 4;
+}
+
+static void queue_text(Client *client, const char *text) {
+    queue_data(client, text, strlen(text));
+}
+
+static void broadcast(const char *text, Client *except) {
+    for (int i = 0; i < client_count; i++) {
+        if (clients + i != except) {
+            queue_text(clients + i, text);
+        }
+    }
+}
+
+static void send_chunk(Client *client, int p, int q, int r, unsigned int version) {
+    static unsigned char generated[VOLUME];
+    static unsigned char message[25 + LZ_BOUND(VOLUME) + 1024];
+    Chunk *chunk = find_chunk(p, q, r);
+    unsigned int current = chunk ? chunk->version : 1;
+    if (version != current) {
+        unsigned char *ws = chunk ? chunk->ws : generated;
+        if (!chunk) {
+            world_generate(generated, p, q, r);
+        }
+        message[0] = 'C';
+        write_int64(message + 1, p);
+        write_int64(message + 9, q);
+        write_int64(message + 17, r);
+        int size = codec_compress(
+            client->codec, message + 25, sizeof(message) - 25, ws, VOLUME);
+        queue_data(client, message, 25 + size);
+        chunks_sent++;
+    }
+    message[0] = 'S';
+    write_int64(message + 1, p);
+    write_int64(message + 9, q);
+    write_int64(message + 17, r);
+    write_int32(message + 25, current);
+    queue_data(client, message, 29);
+}
+
+static int compare_edits(const void *a, const void *b) {
+    const Edit *x = a, *y = b;
+    if (x->p != y->p) return x->p < y->p ? -1 : 1;
+    if (x->q != y->q) return x->q < y->q ? -1 : 1;
+    if (x->r != y->r) return x->r < y->r ? -1 : 1;
+    if (x->index != y->index) return x->index < y->index ? -1 : 1;
+    /* qsort isn't stable, so edits of one block keep their order here */
+    if (x->sequence != y->sequence) return x->sequence < y->sequence ? -1 : 1;
+    return 0;
+}
+
+/* sends the tick's edits, one B message for a lone change in a chunk and
+ * R deltas of runs otherwise, as many as the runs need */
+static void flush_edits() {
+    static unsigned char message[25 + MAX_RUNS * 5];
+    qsort(edits, edit_count, sizeof(Edit), compare_edits);
+    int i = 0;
+    while (i < edit_count) {
+        int j = i;
+        while (j < edit_count && edits[j].p == edits[i].p &&
+            edits[j].q == edits[i].q && edits[j].r == edits[i].r)
+        {
+            j++;
+        }
+        if (j - i == 1) {
+            Edit *e = edits + i;
+            char text[MAX_MESSAGE];
+            snprintf(text, sizeof(text), "B,%d,%d,%d,%d",
+                e->p * CHUNK_SIZE + e->index % CHUNK_SIZE,
+                e->q * CHUNK_SIZE + e->index / CHUNK_SIZE % CHUNK_SIZE,
+                e->r * CHUNK_SIZE + e->index / (CHUNK_SIZE * CHUNK_SIZE),
+                e->w);
+            broadcast(text, 0);
+            i = j;
+            continue;
+        }
+        message[0] = 'R';
+        write_int64(message + 1, edits[i].p);
+        write_int64(message + 9, edits[i].q);
+        write_int64(message + 17, edits[i].r);
+        int size = 25;
+        for (int k = i; k < j; k++) {
+            /* later edits of the same block win */
+            if (k + 1 < j && edits[k + 1].index == edits[k].index) {
+                continue;
+            }
+            int last = size - 5;
+            if (size > 25 &&
+                message[last + 4] == edits[k].w &&
+                ((message[last] << 8 | message[last + 1]) +
+                (message[last + 2] << 8 | message[last + 3])) == edits[k].index)
+            {
+                int length = (message[last + 2] << 8 | message[last + 3]) + 1;
+                message[last + 2] = length >> 8;
+                message[last + 3] = length & 0xff;
+                continue;
+            }
+            if (size + 5 > (int)sizeof(message)) {
+                for (int c = 0; c < client_count; c++) {
+                    queue_data(clients + c, message, size);
+                }
+                size = 25;
+            }
+            message[size++] = edits[k].index >> 8;
+            message[size++] = edits[k].index & 0xff;
+            message[size++] = 0;
+            message[size++] = 1;
+            message[size++] = edits[k].w;
+        }
+        for (int c = 0; c < client_count; c++) {
+            queue_data(clients + c, message, size);
+        }
+        i = j;
+    }
+    edit_count = 0;
+    edit_sequence = 0;
+}
+
+static void add_edit(int x, int y, int z, int w) {
+    if (edit_count == MAX_EDITS) {
+        flush_edits();
+    }
+    set_block(x, y, z, w);
+    Edit *e = edits + edit_count++;
+    e->p = chunked(x);
+    e->q = chunked(y);
+    e->r = chunked(z);
+    e->index = mod_euc(x, CHUNK_SIZE) + mod_euc(y, CHUNK_SIZE) * CHUNK_SIZE +
+        mod_euc(z, CHUNK_SIZE) * CHUNK_SIZE * CHUNK_SIZE;
+    e->w = w;
+    e->sequence = edit_sequence++;
+}
+
+static void send_player(Client *client, int id, const char *name,
+    float x, float y, float z, float rx, float ry)
+{
+    char text[MAX_MESSAGE];
+    snprintf(text, sizeof(text), "P,%d,%.2f,%.2f,%.2f,%.2f,%.2f",
+        id, x, y, z, rx, ry);
+    if (client) {
+        queue_text(client, text);
+        snprintf(text, sizeof(text), "N,%d,%s", id, name);
+        queue_text(client, text);
+    }
+    else {
+        broadcast(text, 0);
+    }
+}
+
+static void on_connect(int fd) {
+    if (client_count == MAX_CLIENTS) {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    Client *client = clients + client_count++;
+    memset(client, 0, sizeof(Client));
+    client->fd = fd;
+    client->id = next_id++;
+    client->codec = CODEC_ZLIB;
+    snprintf(client->name, sizeof(client->name), "player%d", client->id);
+    client->x = client->z = 0;
+    client->y = world_height(0, 0) + 2;
+    char text[MAX_MESSAGE];
+    snprintf(text, sizeof(text), "U,%d,%.2f,%.2f,%.2f,%.2f,%.2f",
+        client->id, client->x, client->y, client->z, 0.0, 0.0);
+    queue_text(client, text);
+    snprintf(text, sizeof(text), "E,%f,%d", now() - start_time, DAY_LENGTH);
+    queue_text(client, text);
+    for (int i = 0; i < client_count - 1; i++) {
+        Client *other = clients + i;
+        send_player(client, other->id, other->name,
+            other->x, other->y, other->z, other->rx, other->ry);
+    }
+    for (int i = 0; i < bot_count; i++) {
+        Bot *bot = bots + i;
+        char name[32];
+        snprintf(name, sizeof(name), "bot%d", i);
+        send_player(client, bot->id, name, bot->x, bot->y, bot->z, bot->rx, bot->ry);
+    }
+    snprintf(text, sizeof(text), "T,%s joined", client->name);
+    broadcast(text, 0);
+}
+
+static void on_message(Client *client, char *data) {
+    char text[MAX_MESSAGE + 64];
+    int p, q, r, x, y, z, w;
+    unsigned int version;
+    float px, py, pz, prx, pry;
+    if (sscanf(data, "C,%d,%d,%d,%u", &p, &q, &r, &version) == 4) {
+        send_chunk(client, p, q, r, version);
+    }
+    else if (sscanf(data, "C,%d,%d,%d", &p, &q, &r) == 3) {
+        send_chunk(client, p, q, r, 0);
+    }
+    else if (sscanf(data, "B,%d,%d,%d,%d", &x, &y, &z, &w) == 4) {
+        if (y > 0 && w >= 0 && w < 256) {
+            set_block(x, y, z, w);
+            snprintf(text, sizeof(text), "B,%d,%d,%d,%d", x, y, z, w);
+            broadcast(text, client);
+        }
+    }
+    else if (sscanf(data, "L,%d,%d,%d,%d", &x, &y, &z, &w) == 4) {
+        snprintf(text, sizeof(text), "L,%d,%d,%d,%d", x, y, z, w);
+        broadcast(text, client);
+    }
+    else if (sscanf(data, "P,%f,%f,%f,%f,%f", &px, &py, &pz, &prx, &pry) == 5) {
+        client->x = px; client->y = py; client->z = pz;
+        client->rx = prx; client->ry = pry;
+        snprintf(text, sizeof(text), "P,%d,%.2f,%.2f,%.2f,%.2f,%.2f",
+            client->id, px, py, pz, prx, pry);
+        broadcast(text, client);
+    }
+    else if (data[0] == 'Z' && data[1] == ',') {
+        /* the client lists codecs best first; take the first we know */
+        char *key;
+        for (char *name = strtok_r(data + 2, ",", &key); name;
+            name = strtok_r(0, ",", &key))
+        {
+            if (codec_find(name) >= 0) {
+                client->codec = codec_find(name);
+                snprintf(text, sizeof(text), "Z,%s", name);
+                queue_text(client, text);
+                break;
+            }
+        }
+    }
+    else if (data[0] == 'A' && data[1] == ',') {
+        char name[32];
+        if (sscanf(data, "A,%31[^,]", name) == 1) {
+            snprintf(client->name, sizeof(client->name), "%s", name);
+            snprintf(text, sizeof(text), "N,%d,%s", client->id, client->name);
+            broadcast(text, client);
+        }
+    }
+    else if (data[0] == 'T' && data[1] == ',') {
+        snprintf(text, sizeof(text), "T,%s> %s", client->name, data + 2);
+        broadcast(text, 0);
+    }
+}
+
+static void on_readable(Client *client) {
+    while (1) {
+        int n = recv(client->fd, client->input + client->input_length,
+            sizeof(client->input) - client->input_length - 1, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            client_free(client);
+            client->fd = -1;
+            return;
+        }
+        if (n < 0) {
+            return;
+        }
+        client->input_length += n;
+        while (client->input_length >= 4) {
+            uint32_t length;
+            memcpy(&length, client->input, 4);
+            length = ntohl(length);
+            if (length > MAX_MESSAGE) {
+                client_free(client);
+                client->fd = -1;
+                return;
+            }
+            if (client->input_length < (int)length + 4) {
+                break;
+            }
+            char data[MAX_MESSAGE + 1];
+            memcpy(data, client->input + 4, length);
+            data[length] = '\0';
+            int rest = client->input_length - length - 4;
+            memmove(client->input, client->input + length + 4, rest);
+            client->input_length = rest;
+            on_message(client, data);
+            if (client->fd < 0) {
+                return;
+            }
+        }
+    }
+}
+
+static void on_writable(Client *client) {
+    while (client->output_length) {
+        int n = send(client->fd, client->output, client->output_length, 0);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                client_free(client);
+                client->fd = -1;
+            }
+            return;
+        }
+        memmove(client->output, client->output + n, client->output_length - n);
+        client->output_length -= n;
+        bytes_sent += n;
+    }
+}
+
+static void remove_closed_clients() {
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].fd >= 0) {
+            continue;
+        }
+        char text[MAX_MESSAGE];
+        int id = clients[i].id;
+        clients[i] = clients[--client_count];
+        i--;
+        snprintf(text, sizeof(text), "D,%d", id);
+        broadcast(text, 0);
+    }
+}
+
+static void init_bots(int count) {
+    bot_count = MIN(count, MAX_BOTS);
+    for (int i = 0; i < bot_count; i++) {
+        Bot *bot = bots + i;
+        memset(bot, 0, sizeof(Bot));
+        bot->id = next_id++;
+        bot->cx = (rand() % 128) - 64;
+        bot->cz = (rand() % 128) - 64;
+        bot->radius = 4 + rand() % 28;
+        bot->angle = rand() % 360;
+        bot->speed = 2 + rand() % 6;
+    }
+}
+
+static void update_bots(double dt, double moves, double edits_per_second) {
+    for (int i = 0; i < bot_count; i++) {
+        Bot *bot = bots + i;
+        bot->angle += dt * bot->speed / bot->radius;
+        bot->x = bot->cx + cosf(bot->angle) * bot->radius;
+        bot->z = bot->cz + sinf(bot->angle) * bot->radius;
+        bot->y = world_height(floorf(bot->x), floorf(bot->z)) + 1;
+        bot->rx = bot->angle;
+        bot->ry = 0;
+        bot->move_debt += dt * moves;
+        if (bot->move_debt >= 1) {
+            bot->move_debt -= floor(bot->move_debt);
+            send_player(0, bot->id, 0, bot->x, bot->y, bot->z, bot->rx, bot->ry);
+        }
+        bot->edit_debt += dt * edits_per_second;
+        for (; bot->edit_debt >= 1; bot->edit_debt -= 1) {
+            /* toggle a block in a small patch by the bot's path */
+            int x = floorf(bot->x) + rand() % 9 - 4;
+            int z = floorf(bot->z) + rand() % 9 - 4;
+            int y = world_height(x, z) + 1 + rand() % 3;
+            int w = get_block(x, y, z) ? EMPTY : COLOR_00 + rand() % 32;
+            add_edit(x, y, z, w);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int port = DEFAULT_PORT;
+    int bot_total = 0;
+    double moves = 10;
+    double edits_per_second = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            bot_total = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            moves = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            edits_per_second = atof(argv[++i]);
+        }
+        else {
+            fprintf(stderr,
+                "Usage: %s [-p PORT] [-b BOTS] [-m MOVES] [-e EDITS]\n",
+                argv[0]);
+            return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    srand(1);
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(sd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(sd, 16) == -1)
+    {
+        perror("bind");
+        return 1;
+    }
+    start_time = now();
+    init_bots(bot_total);
+    printf("listening on port %d with %d bots\n", port, bot_count);
+    fflush(stdout);
+    double last_tick = now();
+    double last_report = last_tick;
+    struct pollfd fds[MAX_CLIENTS + 1];
+    while (1) {
+        fds[0].fd = sd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < client_count; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN | (clients[i].output_length ? POLLOUT : 0);
+        }
+        int count = client_count;
+        double wait = last_tick + 1.0 / TICK_RATE - now();
+        poll(fds, count + 1, wait > 0 ? (int)(wait * 1000) : 0);
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(sd, 0, 0);
+            if (fd >= 0) {
+                on_connect(fd);
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            Client *client = clients + i;
+            if (client->fd >= 0 && fds[i + 1].revents & (POLLIN | POLLHUP)) {
+                on_readable(client);
+            }
+            if (client->fd >= 0 && fds[i + 1].revents & POLLOUT) {
+                on_writable(client);
+            }
+        }
+        remove_closed_clients();
+        double t = now();
+        if (t - last_tick >= 1.0 / TICK_RATE) {
+            update_bots(t - last_tick, moves, edits_per_second);
+            flush_edits();
+            last_tick = t;
+        }
+        if (t - last_report >= 5) {
+            printf("%d clients, %d bots, %ld chunks sent, %.1f MB sent, "
+                "%u chunks edited\n", client_count, bot_count, chunks_sent,
+                bytes_sent / 1e6, world.count);
+            fflush(stdout);
+            last_report = t;
+        }
+    }
+    return 0;
+}
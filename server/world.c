@@ -0,0 +1,85 @@
+#include <math.h>
+#include <string.h>
+#include "config.h"
+#include "item.h"
+#include "world.h"
+
+#define VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+
+static float lattice(int x, int z, int seed) {
+    unsigned int h = x * 374761393u + z * 668265263u + seed * 2147483647u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return ((h ^ (h >> 16)) & 0xffff) / 65535.0f;
+}
+
+static float value_noise(float x, float z, int seed) {
+    int ix = floorf(x), iz = floorf(z);
+    float fx = x - ix, fz = z - iz;
+    fx = fx * fx * (3 - 2 * fx);
+    fz = fz * fz * (3 - 2 * fz);
+    float a = lattice(ix, iz, seed), b = lattice(ix + 1, iz, seed);
+    float c = lattice(ix, iz + 1, seed), d = lattice(ix + 1, iz + 1, seed);
+    return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fz;
+}
+
+static float fbm(float x, float z, int seed) {
+    return value_noise(x / 64, z / 64, seed) * 0.5 +
+        value_noise(x / 32, z / 32, seed) * 0.25 +
+        value_noise(x / 16, z / 16, seed) * 0.125 +
+        value_noise(x / 8, z / 8, seed) * 0.125;
+}
+
+int world_height(int x, int z) {
+    return 8 + fbm(x, z, 1) * 40;
+}
+
+/* rolling hills, trees and clouds */
+void world_generate(unsigned char *ws, int p, int q, int r) {
+    memset(ws, 0, VOLUME);
+    for (int dx = 0; dx < CHUNK_SIZE; dx++) {
+        for (int dz = 0; dz < CHUNK_SIZE; dz++) {
+            int x = p * CHUNK_SIZE + dx;
+            int z = r * CHUNK_SIZE + dz;
+            int h = world_height(x, z);
+            int top = h < 14 ? SAND : GRASS;
+            float f = lattice(x, z, 2);
+            int plant = top == GRASS && f > 0.9 ?
+                (f > 0.98 ? YELLOW_FLOWER + (int)(f * 1000) % 6 : TALL_GRASS) : 0;
+            for (int dy = 0; dy < CHUNK_SIZE; dy++) {
+                int y = q * CHUNK_SIZE + dy;
+                int w = 0;
+                if (y < h - 3) w = STONE;
+                else if (y < h) w = top == SAND ? SAND : DIRT;
+                else if (y == h) w = top;
+                else if (y == h + 1) w = plant;
+                else if (y >= 64 && y < 72 && fbm(x * 2, z * 2, 3) > 0.62) w = CLOUD;
+                ws[dx + dy * CHUNK_SIZE + dz * CHUNK_SIZE * CHUNK_SIZE] = w;
+            }
+        }
+    }
+    /* trees never cross chunk borders, which is close enough */
+    for (int dx = 2; dx < CHUNK_SIZE - 2; dx += 7) {
+        for (int dz = 2; dz < CHUNK_SIZE - 2; dz += 7) {
+            int x = p * CHUNK_SIZE + dx;
+            int z = r * CHUNK_SIZE + dz;
+            int h = world_height(x, z);
+            if (h < 14 || lattice(x, z, 4) < 0.6) {
+                continue;
+            }
+            for (int y = h + 1; y < h + 9; y++) {
+                for (int ox = -2; ox <= 2; ox++) {
+                    for (int oz = -2; oz <= 2; oz++) {
+                        int ly = y - q * CHUNK_SIZE;
+                        if (ly < 0 || ly >= CHUNK_SIZE) continue;
+                        int w = 0;
+                        if (ox == 0 && oz == 0 && y < h + 7) w = WOOD;
+                        else if (y > h + 3 && ox * ox + oz * oz + (y - h - 6) * (y - h - 6) <= 6) w = LEAVES;
+                        if (w) {
+                            ws[(dx + ox) + ly * CHUNK_SIZE + (dz + oz) * CHUNK_SIZE * CHUNK_SIZE] = w;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,7 @@
+#ifndef _world_h_
+#define _world_h_
+
+int world_height(int x, int z);
+void world_generate(unsigned char *ws, int p, int q, int r);
+
+#endif
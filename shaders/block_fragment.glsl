@@ -1,11 +1,20 @@
 #version 120
 
+#ifdef TEXTURE_ARRAY
+#extension GL_EXT_texture_array : enable
+uniform sampler2DArray texture;
+#else
 uniform sampler2D texture;
+#endif
 uniform int render_dist;
 uniform vec3 camera;
 uniform float timer;
 
+#ifdef TEXTURE_ARRAY
+varying vec3 fuv;
+#else
 varying vec2 fuv;
+#endif
 varying float ao;
 varying float light;
 varying float dist;
@@ -19,12 +28,20 @@ float quantize(float x, int n) {
 
 float dither(float a) {
     float n = mod(gl_FragCoord.x + gl_FragCoord.y, 6.0);
-    float q = trunc(a * 2.0) * 0.5;
+    float q = floor(a * 2.0) * 0.5;
     return q + ((a - q) * 6.0 * 4.0 < n ? 0.0 : 0.5);
 }
 
 void main() {
+#ifdef TEXTURE_ARRAY
+    vec4 color = texture2DArray(texture, fuv);
+#else
     vec4 color = texture2D(texture, fuv);
+#endif
+#ifdef CUTOUT
+    if (color.a < 0.5)
+        discard;
+#endif
     float l = 1.0;
     if (fnormal.y == 0.0)
         l *= 0.5;
@@ -7,7 +7,11 @@ attribute vec4 position;
 attribute vec3 normal;
 attribute vec4 uv;
 
+#ifdef TEXTURE_ARRAY
+varying vec3 fuv;
+#else
 varying vec2 fuv;
+#endif
 varying float ao;
 varying float light;
 varying float dist;
@@ -18,7 +22,13 @@ void main() {
     ao = uv.z;
     light = uv.w;
     dist = distance(position.xyz, camera);
+#ifdef TEXTURE_ARRAY
+    // the atlas is 16 tiles across, each a layer of the array
+    vec2 tile = floor(uv.xy * 16.0);
+    fuv = vec3(uv.xy * 16.0 - tile, tile.x + tile.y * 16.0);
+#else
     fuv = uv.xy;
+#endif
     fnormal = normal;
 }
 
@@ -0,0 +1,58 @@
+#version 120
+
+uniform mat4 matrix;
+uniform vec3 camera;
+uniform float time;
+
+attribute vec4 position;
+attribute vec3 normal;
+attribute vec4 uv;
+attribute vec4 from; // x, y, z and time of the update before last
+attribute vec4 to; // the same for the last update
+attribute vec4 angles; // rx, ry at each
+
+#ifdef TEXTURE_ARRAY
+varying vec3 fuv;
+#else
+varying vec2 fuv;
+#endif
+varying float ao;
+varying float light;
+varying float dist;
+varying vec3 fnormal;
+
+// the same rotation as mat_rotate
+mat3 rotation(vec3 axis, float angle) {
+    vec3 a = normalize(axis);
+    float s = sin(angle);
+    float c = cos(angle);
+    float m = 1.0 - c;
+    return mat3(
+        m * a.x * a.x + c, m * a.x * a.y - a.z * s, m * a.z * a.x + a.y * s,
+        m * a.x * a.y + a.z * s, m * a.y * a.y + c, m * a.y * a.z - a.x * s,
+        m * a.z * a.x - a.y * s, m * a.y * a.z + a.x * s, m * a.z * a.z + c);
+}
+
+void main() {
+    // catches up with the last update over the time it took to come
+    float span = clamp(to.w - from.w, 0.1, 1.0);
+    float p = clamp((time - to.w) / span, 0.0, 1.0);
+    float rx = mix(angles.x, angles.z, p);
+    float ry = mix(angles.y, angles.w, p);
+    mat3 turn =
+        rotation(vec3(cos(rx), 0.0, sin(rx)), -ry) *
+        rotation(vec3(0.0, 1.0, 0.0), rx);
+    vec3 world = turn * position.xyz + mix(from.xyz, to.xyz, p);
+    gl_Position = matrix * vec4(world, 1.0);
+    ao = uv.z;
+    light = uv.w;
+    dist = distance(world, camera);
+#ifdef TEXTURE_ARRAY
+    // the atlas is 16 tiles across, each a layer of the array
+    vec2 tile = floor(uv.xy * 16.0);
+    fuv = vec3(uv.xy * 16.0 - tile, tile.x + tile.y * 16.0);
+#else
+    fuv = uv.xy;
+#endif
+    fnormal = turn * normal;
+}
@@ -0,0 +1,214 @@
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 200809L
+    #include <sys/stat.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/glew.h>
+#include "atlas.h"
+#include "lodepng.h"
+#include "lz.h"
+#include "util.h"
+
+#define ATLAS_MAGIC 0x41544c31 /* "ATL1" */
+
+/* followed by every level of every layer, largest level first, as one
+ * lz block. the png's size and hash tell when the cache is out of date */
+typedef struct {
+    unsigned int magic;
+    unsigned int source_size;
+    unsigned int source_hash;
+    unsigned int tile;
+    unsigned int layers;
+    unsigned int levels;
+    unsigned int size;
+    unsigned int packed;
+} AtlasHeader;
+
+static unsigned int atlas_hash(const unsigned char *data, size_t size) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned char *read_all(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+    unsigned char *data = malloc(length > 0 ? length : 1);
+    if (length < 0 || fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    *size = length;
+    return data;
+}
+
+static size_t atlas_size(int tile, int layers, int levels) {
+    size_t size = 0;
+    for (int i = 0; i < levels; i++) {
+        size_t n = tile >> i;
+        size += n * n * 4 * layers;
+    }
+    return size;
+}
+
+/* cuts the image into layers, then halves each layer down to a texel,
+ * averaging every two by two block */
+static void build_levels(
+    unsigned char *data, const unsigned char *image, int width,
+    int columns, int tile, int layers, int levels)
+{
+    unsigned char *dst = data;
+    for (int i = 0; i < layers; i++) {
+        int x = (i % columns) * tile;
+        int y = (i / columns) * tile;
+        for (int j = 0; j < tile; j++) {
+            memcpy(dst, image + ((size_t)(y + j) * width + x) * 4, tile * 4);
+            dst += tile * 4;
+        }
+    }
+    unsigned char *src = data;
+    for (int level = 1; level < levels; level++) {
+        int m = tile >> (level - 1);
+        int n = tile >> level;
+        for (int i = 0; i < layers; i++) {
+            const unsigned char *layer = src + (size_t)i * m * m * 4;
+            for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                    const unsigned char *a = layer + ((2 * y) * m + 2 * x) * 4;
+                    const unsigned char *b = a + m * 4;
+                    for (int c = 0; c < 4; c++) {
+                        *(dst++) = (a[c] + a[c + 4] + b[c] + b[c + 4] + 2) / 4;
+                    }
+                }
+            }
+        }
+        src += (size_t)m * m * 4 * layers;
+    }
+}
+
+static unsigned char *load_cache(
+    const char *path, AtlasHeader *header,
+    unsigned int source_size, unsigned int source_hash)
+{
+    size_t size;
+    unsigned char *file = read_all(path, &size);
+    if (!file) {
+        return 0;
+    }
+    unsigned char *data = 0;
+    memcpy(header, file, MIN(size, sizeof(AtlasHeader)));
+    if (size >= sizeof(AtlasHeader) &&
+        header->magic == ATLAS_MAGIC &&
+        header->source_size == source_size &&
+        header->source_hash == source_hash &&
+        header->packed == size - sizeof(AtlasHeader) &&
+        header->levels > 0 && header->levels <= 16 &&
+        header->size == atlas_size(
+            header->tile, header->layers, header->levels))
+    {
+        data = malloc(header->size);
+        int length = lz_decompress(
+            file + sizeof(AtlasHeader), header->packed,
+            data, header->size, 0, 0);
+        if (length != (int)header->size) {
+            free(data);
+            data = 0;
+        }
+    }
+    free(file);
+    return data;
+}
+
+static void store_cache(
+    const char *path, AtlasHeader *header, const unsigned char *data)
+{
+#ifndef _WIN32
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+    }
+#endif
+    unsigned char *packed = malloc(LZ_BOUND(header->size));
+    int length = lz_compress(
+        data, header->size, packed, LZ_BOUND(header->size), 0, 0);
+    FILE *file = length > 0 ? fopen(path, "wb") : 0;
+    if (file) {
+        header->packed = length;
+        if (fwrite(header, sizeof(AtlasHeader), 1, file) != 1 ||
+            fwrite(packed, 1, length, file) != (size_t)length)
+        {
+            fprintf(stderr, "atlas cache %s not written\n", path);
+        }
+        fclose(file);
+    }
+    free(packed);
+}
+
+/* uploads to the GL_TEXTURE_2D_ARRAY bound; tiles are numbered from the
+ * bottom left, as uvs count them, and columns tiles make up a row */
+void atlas_load(const char *file_name, const char *cache_path, int columns) {
+    size_t source_size;
+    unsigned char *source = read_all(file_name, &source_size);
+    if (!source) {
+        fprintf(stderr, "atlas_load %s failed\n", file_name);
+        exit(1);
+    }
+    unsigned int source_hash = atlas_hash(source, source_size);
+    AtlasHeader header;
+    unsigned char *data = load_cache(
+        cache_path, &header, source_size, source_hash);
+    if (!data) {
+        unsigned char *image;
+        unsigned int width, height;
+        unsigned int error = lodepng_decode32(
+            &image, &width, &height, source, source_size);
+        if (error) {
+            fprintf(stderr, "atlas_load %s failed, error %u: %s\n",
+                file_name, error, lodepng_error_text(error));
+            exit(1);
+        }
+        flip_image_vertical(image, width, height);
+        int tile = width / columns;
+        int levels = 0;
+        while (tile >> levels) {
+            levels++;
+        }
+        header.magic = ATLAS_MAGIC;
+        header.source_size = source_size;
+        header.source_hash = source_hash;
+        header.tile = tile;
+        header.layers = columns * (height / tile);
+        header.levels = levels;
+        header.size = atlas_size(tile, header.layers, levels);
+        data = malloc(header.size);
+        build_levels(
+            data, image, width, columns, tile, header.layers, levels);
+        free(image);
+        store_cache(cache_path, &header, data);
+    }
+    free(source);
+    const unsigned char *level = data;
+    for (unsigned int i = 0; i < header.levels; i++) {
+        int n = header.tile >> i;
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, n, n, header.layers,
+            0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+        level += (size_t)n * n * 4 * header.layers;
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, header.levels - 1);
+    free(data);
+}
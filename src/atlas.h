@@ -0,0 +1,8 @@
+#ifndef _atlas_h_
+#define _atlas_h_
+
+/* the block atlas as a texture array, one layer per tile, with mipmaps.
+ * the layers are kept in a cache file so later runs skip the png */
+void atlas_load(const char *file_name, const char *cache_path, int columns);
+
+#endif
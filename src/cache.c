@@ -0,0 +1,182 @@
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 200809L
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "cache.h"
+#include "config.h"
+
+#define CACHE_MAGIC 0x43434331 /* "CCC1" */
+#define CACHE_WAYS 4
+#define CACHE_VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+
+typedef struct {
+    unsigned int magic;
+    unsigned int chunk_size;
+    unsigned int sets;
+    unsigned int clock;
+} CacheHeader;
+
+typedef struct {
+    int p;
+    int q;
+    int r;
+    unsigned int version;
+    unsigned int used;
+    unsigned int reserved[3];
+    unsigned char ws[CACHE_VOLUME];
+} CacheSlot;
+
+static CacheHeader *header = 0;
+static CacheSlot *slots = 0;
+static size_t mapped_size = 0;
+
+static unsigned int cache_hash(int p, int q, int r) {
+    unsigned int h = p * 73856093u ^ q * 19349663u ^ r * 83492791u;
+    h = ((h >> 16) ^ h) * 0x45d9f3b;
+    return (h >> 16) ^ h;
+}
+
+static CacheSlot *cache_find(int p, int q, int r) {
+    CacheSlot *set = slots + (cache_hash(p, q, r) % header->sets) * CACHE_WAYS;
+    for (int i = 0; i < CACHE_WAYS; i++) {
+        CacheSlot *slot = set + i;
+        if (slot->used && slot->p == p && slot->q == q && slot->r == r) {
+            return slot;
+        }
+    }
+    return 0;
+}
+
+#ifdef _WIN32
+
+void cache_open(const char *hostname, int port) {
+}
+
+void cache_close() {
+}
+
+#else
+
+/* the hostname as a file name: anything but letters, digits, '-', ':'
+ * and single dots not at the start becomes '_', so no name can leave
+ * the cache directory */
+static void cache_name(char *name, size_t size, const char *hostname) {
+    size_t i = 0;
+    for (; hostname[i] && i + 1 < size; i++) {
+        char c = hostname[i];
+        int ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '-' || c == ':' ||
+            (c == '.' && i && hostname[i - 1] != '.');
+        name[i] = ok ? c : '_';
+    }
+    name[i] = '\0';
+}
+
+void cache_open(const char *hostname, int port) {
+    cache_close();
+    if (!USE_CHUNK_CACHE) {
+        return;
+    }
+    char name[256];
+    char path[1024];
+    cache_name(name, sizeof(name), hostname);
+    mkdir(CHUNK_CACHE_PATH, 0755);
+    snprintf(path, sizeof(path), "%s/%s.%d", CHUNK_CACHE_PATH, name, port);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        perror("cache_open");
+        return;
+    }
+    size_t size = sizeof(CacheHeader) +
+        sizeof(CacheSlot) * CHUNK_CACHE_SETS * CACHE_WAYS;
+    CacheHeader current;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < size ||
+        read(fd, &current, sizeof(current)) != sizeof(current) ||
+        current.magic != CACHE_MAGIC ||
+        current.chunk_size != CHUNK_SIZE ||
+        current.sets != CHUNK_CACHE_SETS)
+    {
+        /* missing, incompatible or cut short, which mapping it whole
+         * would fault on; start over with a sparse file */
+        if (ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1) {
+            perror("cache_open");
+            close(fd);
+            return;
+        }
+        current.magic = CACHE_MAGIC;
+        current.chunk_size = CHUNK_SIZE;
+        current.sets = CHUNK_CACHE_SETS;
+        current.clock = 0;
+        if (pwrite(fd, &current, sizeof(current), 0) != sizeof(current)) {
+            perror("cache_open");
+            close(fd);
+            return;
+        }
+    }
+    void *data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return;
+    }
+    header = (CacheHeader *)data;
+    slots = (CacheSlot *)(header + 1);
+    mapped_size = size;
+}
+
+void cache_close() {
+    if (!header) {
+        return;
+    }
+    munmap(header, mapped_size);
+    header = 0;
+    slots = 0;
+    mapped_size = 0;
+}
+
+#endif
+
+unsigned int cache_load(int p, int q, int r, unsigned char *data) {
+    if (!header) {
+        return 0;
+    }
+    CacheSlot *slot = cache_find(p, q, r);
+    if (!slot) {
+        return 0;
+    }
+    slot->used = ++header->clock;
+    memcpy(data, slot->ws, CACHE_VOLUME);
+    return slot->version;
+}
+
+void cache_store(int p, int q, int r, unsigned int version,
+    const unsigned char *data)
+{
+    if (!header || !version) {
+        return;
+    }
+    CacheSlot *slot = cache_find(p, q, r);
+    if (!slot) {
+        /* evict the least recently used way */
+        CacheSlot *set = slots + (cache_hash(p, q, r) % header->sets) * CACHE_WAYS;
+        slot = set;
+        for (int i = 1; i < CACHE_WAYS; i++) {
+            if (set[i].used < slot->used) {
+                slot = set + i;
+            }
+        }
+    }
+    slot->p = p;
+    slot->q = q;
+    slot->r = r;
+    slot->version = version;
+    slot->used = ++header->clock;
+    memcpy(slot->ws, data, CACHE_VOLUME);
+}
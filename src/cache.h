@@ -0,0 +1,10 @@
+#ifndef _cache_h_
+#define _cache_h_
+
+void cache_open(const char *hostname, int port);
+void cache_close();
+unsigned int cache_load(int p, int q, int r, unsigned char *data);
+void cache_store(int p, int q, int r, unsigned int version,
+    const unsigned char *data);
+
+#endif
@@ -29,6 +29,11 @@ static char buf[QUEUE_SIZE] = { 0 };
 static int bpos = 0;
 static thrd_t recv_thread;
 static mtx_t mutex;
+static FILE *capture = 0;
+static double capture_start = -1;
+static char replay_path[1024] = { 0 };
+static int replay_fast = 0;
+static int replay_finished = 0;
 
 void client_enable() {
     client_enabled = 1;
@@ -43,7 +48,7 @@ int get_client_enabled() {
 }
 
 int client_sendall(int sd, char *data, int length) {
-    if (!client_enabled) {
+    if (!client_enabled || replay_path[0]) {
         return 0;
     }
     int count = 0;
@@ -84,6 +89,15 @@ void client_version(int version) {
     client_send(buffer);
 }
 
+void client_codecs(const char *codecs) {
+    if (!client_enabled) {
+        return;
+    }
+    char buffer[1024];
+    snprintf(buffer, 1024, "Z,%s", codecs);
+    client_send(buffer);
+}
+
 void client_login(const char *username, const char *identity_token) {
     if (!client_enabled) {
         return;
@@ -113,12 +127,17 @@ void client_position(float x, float y, float z, float rx, float ry) {
     client_send(buffer);
 }
 
-void client_chunk(int p, int q, int r) {
+void client_chunk(int p, int q, int r, unsigned int version) {
     if (!client_enabled) {
         return;
     }
     char buffer[1024];
-    snprintf(buffer, 1024, "C,%d,%d,%d", p, q, r);
+    if (version) {
+        snprintf(buffer, 1024, "C,%d,%d,%d,%u", p, q, r, version);
+    }
+    else {
+        snprintf(buffer, 1024, "C,%d,%d,%d", p, q, r);
+    }
     client_send(buffer);
 }
 
@@ -169,9 +188,50 @@ char *client_recv(size_t *size) {
     return result;
 }
 
+static double client_time() {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    clock_gettime(TIME_UTC, &ts);
+#endif
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* size includes the terminating NUL */
+static void client_enqueue(char *data, uint32_t size) {
+    while (1) {
+        int done = 0;
+        mtx_lock(&mutex);
+        if (bpos + size + sizeof(size_t) < QUEUE_SIZE) {
+            *(size_t *)&buf[bpos] = size;
+            memcpy(buf + bpos + sizeof(size_t), data, size);
+            bpos += size + sizeof(size_t);
+            done = 1;
+        }
+        mtx_unlock(&mutex);
+        if (done) {
+            break;
+        }
+        sleep(0);
+    }
+}
+
+static void capture_write(FILE *file, double start, char *data, uint32_t size) {
+    uint32_t header[2];
+    header[0] = htonl((uint32_t)((client_time() - start) * 1000));
+    header[1] = htonl(size);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(data, 1, size, file);
+    fflush(file);
+}
+
 int recv_worker(void *arg) {
     char *data = malloc(RECV_SIZE + 1);
     uint32_t size;
+    if (capture && capture_start < 0) {
+        capture_start = client_time();
+    }
     while (1) {
         if (recv(sd, &size, 4, 0) <= 0) {
             if (running) {
@@ -200,29 +260,96 @@ int recv_worker(void *arg) {
             }
             t += len;
         }
+        if (capture) {
+            capture_write(capture, capture_start, data, size);
+        }
         data[size++] = '\0';
-        while (1) {
-            int done = 0;
-            mtx_lock(&mutex);
-            if (bpos + size + sizeof(size_t) < QUEUE_SIZE) {
-                *(size_t *)&buf[bpos] = size;
-                memcpy(buf + bpos + sizeof(size_t), data, size);
-                bpos += size + sizeof(size_t);
-                done = 1;
-            }
-            mtx_unlock(&mutex);
-            if (done) {
-                break;
-            }
-            sleep(0);
+        client_enqueue(data, size);
+    }
+    free(data);
+    return 0;
+}
+
+/* feeds a capture through the same queue, at its original pace unless
+ * replay_fast is set */
+int replay_worker(void *arg) {
+    char *data = malloc(RECV_SIZE + 1);
+    char magic[CAPTURE_MAGIC_SIZE];
+    FILE *file = fopen(replay_path, "rb");
+    if (!file) {
+        perror(replay_path);
+        exit(1);
+    }
+    if (fread(magic, 1, CAPTURE_MAGIC_SIZE, file) != CAPTURE_MAGIC_SIZE ||
+        memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE))
+    {
+        fprintf(stderr, "%s: not a capture\n", replay_path);
+        exit(1);
+    }
+    double start = client_time();
+    uint32_t header[2];
+    while (running && fread(header, sizeof(header), 1, file) == 1) {
+        double t = ntohl(header[0]) / 1000.0;
+        uint32_t size = ntohl(header[1]);
+        if (size > RECV_SIZE || fread(data, 1, size, file) != size) {
+            fprintf(stderr, "%s: truncated capture\n", replay_path);
+            break;
+        }
+        double wait = start + t - client_time();
+        if (!replay_fast && wait > 0) {
+            struct timespec ts;
+            ts.tv_sec = wait;
+            ts.tv_nsec = (wait - ts.tv_sec) * 1e9;
+            thrd_sleep(&ts, NULL);
         }
+        data[size++] = '\0';
+        client_enqueue(data, size);
     }
+    fclose(file);
+    mtx_lock(&mutex);
+    replay_finished = 1;
+    mtx_unlock(&mutex);
     free(data);
     return 0;
 }
 
+/* opens the capture once, so reconnecting carries on with the same
+ * file and clock rather than starting over; a null path closes it */
+void client_record(const char *path) {
+    if (capture) {
+        fclose(capture);
+        capture = 0;
+    }
+    capture_start = -1;
+    if (!path) {
+        return;
+    }
+    capture = fopen(path, "wb");
+    if (capture) {
+        fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_SIZE, capture);
+    }
+    else {
+        perror(path);
+    }
+}
+
+void client_replay(const char *path, int fast) {
+    snprintf(replay_path, sizeof(replay_path), "%s", path);
+    replay_fast = fast;
+}
+
+int client_replay_done() {
+    if (!client_enabled || !replay_path[0]) {
+        return 0;
+    }
+    mtx_lock(&mutex);
+    int result = replay_finished && bpos == 0;
+    mtx_unlock(&mutex);
+    return result;
+}
+
 void client_connect(char *hostname, int port) {
-    if (!client_enabled) {
+    if (!client_enabled || replay_path[0]) {
         return;
     }
     struct hostent *host;
@@ -251,8 +378,10 @@ void client_start() {
     }
     running = 1;
     bpos = 0;
+    replay_finished = 0;
     mtx_init(&mutex, mtx_plain);
-    if (thrd_create(&recv_thread, recv_worker, NULL) != thrd_success) {
+    thrd_start_t worker = replay_path[0] ? replay_worker : recv_worker;
+    if (thrd_create(&recv_thread, worker, NULL) != thrd_success) {
         perror("thrd_create");
         exit(1);
     }
@@ -263,7 +392,9 @@ void client_stop() {
         return;
     }
     running = 0;
-    close(sd);
+    if (!replay_path[0]) {
+        close(sd);
+    }
     // if (thrd_join(recv_thread, NULL) != thrd_success) {
     //     perror("thrd_join");
     //     exit(1);
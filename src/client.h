@@ -3,18 +3,27 @@
 
 #define DEFAULT_PORT 4080
 
+/* a capture is this magic, then each message received as
+ * [32-bit milliseconds since first connecting][32-bit size][message] */
+#define CAPTURE_MAGIC "CRAFTCAP"
+#define CAPTURE_MAGIC_SIZE 8
+
 void client_enable();
 void client_disable();
 int get_client_enabled();
 void client_connect(char *hostname, int port);
 void client_start();
 void client_stop();
+void client_record(const char *path);
+void client_replay(const char *path, int fast);
+int client_replay_done();
 void client_send(char *data);
 char *client_recv();
 void client_version(int version);
+void client_codecs(const char *codecs);
 void client_login(const char *username, const char *identity_token);
 void client_position(float x, float y, float z, float rx, float ry);
-void client_chunk(int p, int q, int r);
+void client_chunk(int p, int q, int r, unsigned int version);
 void client_block(int x, int y, int z, int w);
 void client_light(int x, int y, int z, int w);
 void client_talk(const char *text);
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+#include "codec.h"
+#include "lz.h"
+#include "miniz.h"
+
+static const char *names[CODEC_COUNT] = {
+    "lzd",
+    "lz",
+    "zlib"
+};
+
+int codec_find(const char *name) {
+    for (int i = 0; i < CODEC_COUNT; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *codec_name(int codec) {
+    return names[codec];
+}
+
+void codec_list(char *buffer, int size) {
+    *buffer = '\0';
+    for (int i = 0; i < CODEC_COUNT; i++) {
+        if (i) {
+            strncat(buffer, ",", size - strlen(buffer) - 1);
+        }
+        strncat(buffer, names[i], size - strlen(buffer) - 1);
+    }
+}
+
+int codec_compress(
+    int codec, unsigned char *dst, int dst_capacity,
+    const unsigned char *src, int src_size)
+{
+    switch (codec) {
+        case CODEC_LZ_DICT:
+            return lz_compress(
+                src, src_size, dst, dst_capacity,
+                chunk_dict, chunk_dict_size);
+        case CODEC_LZ:
+            return lz_compress(src, src_size, dst, dst_capacity, 0, 0);
+        case CODEC_ZLIB:
+            /* raw deflate at the default level, as the server sends it */
+            return tdefl_compress_mem_to_mem(
+                dst, dst_capacity, src, src_size, 128);
+        default:
+            return 0;
+    }
+}
+
+int codec_decompress(
+    int codec, unsigned char *dst, int dst_capacity,
+    const unsigned char *src, int src_size)
+{
+    size_t result;
+    switch (codec) {
+        case CODEC_LZ_DICT:
+            return lz_decompress(
+                src, src_size, dst, dst_capacity,
+                chunk_dict, chunk_dict_size);
+        case CODEC_LZ:
+            return lz_decompress(src, src_size, dst, dst_capacity, 0, 0);
+        case CODEC_ZLIB:
+            result = tinfl_decompress_mem_to_mem(
+                dst, dst_capacity, src, src_size, 0);
+            return result == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED ? -1 : (int)result;
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef _codec_h_
+#define _codec_h_
+
+/* chunk payload codecs, in order of preference */
+#define CODEC_LZ_DICT 0
+#define CODEC_LZ 1
+#define CODEC_ZLIB 2
+#define CODEC_COUNT 3
+
+extern const unsigned char chunk_dict[];
+extern const int chunk_dict_size;
+
+int codec_find(const char *name);
+const char *codec_name(int codec);
+void codec_list(char *buffer, int size);
+int codec_compress(
+    int codec, unsigned char *dst, int dst_capacity,
+    const unsigned char *src, int src_size);
+int codec_decompress(
+    int codec, unsigned char *dst, int dst_capacity,
+    const unsigned char *src, int src_size);
+
+#endif
@@ -36,10 +36,23 @@
 #define CRAFT_KEY_ORTHO 'F'
 #define CRAFT_KEY_CHAT 't'
 #define CRAFT_KEY_COMMAND '/'
+#define CRAFT_KEY_PROFILE GLFW_KEY_F3
 
 // advanced parameters
 #define CHUNK_RADIUS 10
 #define CHUNK_SIZE 32
 #define COMMIT_INTERVAL 5
+#define USE_CHUNK_CACHE 1
+#define CHUNK_CACHE_PATH "cache"
+#define CHUNK_CACHE_SETS 1024
+#define TEXTURE_CACHE_PATH "cache/texture"
+#define USE_PROGRAM_CACHE 1
+#define PROGRAM_CACHE_PATH "cache/program"
+#define LOD_DISTANCE 8
+#define REGION_DISTANCE 16
+#define POOL_PAGE_VERTICES (1 << 20)
+#define POOL_DEFRAG_VERTICES (1 << 16)
+#define USE_TRACE 1
+#define TRACE_EVENTS 8192
 
 #endif
@@ -145,9 +145,10 @@ void make_plant(
         {0, 3, 1, 0, 2, 3}
     };
     float *d = data;
+    /* inset like cube faces, so no corner lands on the next tile */
     float s = 0.0625;
-    float a = 0;
-    float b = s;
+    float a = 0 + 1 / 2048.0;
+    float b = s - 1 / 2048.0;
     float du = (plants[w] % 16) * s;
     float dv = (plants[w] / 16) * s;
     for (int i = 0; i < 4; i++) {
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cull.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define CULL_BATCH 4
+
+void cull_clear(CullBoxes *boxes) {
+    boxes->count = 0;
+}
+
+void cull_free(CullBoxes *boxes) {
+    for (int i = 0; i < 3; i++) {
+        free(boxes->lo[i]);
+        free(boxes->hi[i]);
+    }
+    memset(boxes, 0, sizeof(CullBoxes));
+}
+
+/* returns the box's index */
+int cull_add(
+    CullBoxes *boxes, float x0, float y0, float z0,
+    float x1, float y1, float z1)
+{
+    if (boxes->count + CULL_BATCH > boxes->capacity) {
+        boxes->capacity = boxes->capacity ? boxes->capacity * 2 : 1024;
+        for (int i = 0; i < 3; i++) {
+            boxes->lo[i] = realloc(
+                boxes->lo[i], sizeof(float) * boxes->capacity);
+            boxes->hi[i] = realloc(
+                boxes->hi[i], sizeof(float) * boxes->capacity);
+        }
+    }
+    int index = boxes->count++;
+    float lo[3] = {x0, y0, z0};
+    float hi[3] = {x1, y1, z1};
+    for (int i = 0; i < 3; i++) {
+        boxes->lo[i][index] = lo[i];
+        boxes->hi[i][index] = hi[i];
+    }
+    return index;
+}
+
+/* a box is outside a plane when its corner furthest along the plane's
+ * normal is; which corner that is depends only on the normal's signs */
+int cull_box(float planes[6][4], const float lo[3], const float hi[3]) {
+    for (int i = 0; i < 6; i++) {
+        float *plane = planes[i];
+        float x = plane[0] >= 0 ? hi[0] : lo[0];
+        float y = plane[1] >= 0 ? hi[1] : lo[1];
+        float z = plane[2] >= 0 ? hi[2] : lo[2];
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* sets result[i] to whether box i is in the frustum. the corner to test
+ * is picked once per plane for the whole array, so every batch runs
+ * without branches */
+void cull_test(CullBoxes *boxes, float planes[6][4], char *result) {
+    int count = boxes->count;
+    int padded = (count + CULL_BATCH - 1) / CULL_BATCH * CULL_BATCH;
+    for (int i = 0; i < 3; i++) {
+        for (int j = count; j < padded; j++) {
+            boxes->lo[i][j] = boxes->hi[i][j] = 0;
+        }
+    }
+    const float *corners[6][3];
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 3; j++) {
+            corners[i][j] = planes[i][j] >= 0 ? boxes->hi[j] : boxes->lo[j];
+        }
+    }
+#ifdef __SSE__
+    for (int i = 0; i < padded; i += CULL_BATCH) {
+        __m128 zero = _mm_setzero_ps();
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int j = 0; j < 6; j++) {
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(_mm_set1_ps(planes[j][0]),
+                        _mm_loadu_ps(corners[j][0] + i)),
+                    _mm_mul_ps(_mm_set1_ps(planes[j][1]),
+                        _mm_loadu_ps(corners[j][1] + i))),
+                _mm_mul_ps(_mm_set1_ps(planes[j][2]),
+                    _mm_loadu_ps(corners[j][2] + i)));
+            d = _mm_add_ps(d, _mm_set1_ps(planes[j][3]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for (int j = 0; j < CULL_BATCH && i + j < count; j++) {
+            result[i + j] = (mask >> j) & 1;
+        }
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        int inside = 1;
+        for (int j = 0; j < 6; j++) {
+            float d =
+                planes[j][0] * corners[j][0][i] +
+                planes[j][1] * corners[j][1][i] +
+                planes[j][2] * corners[j][2][i] +
+                planes[j][3];
+            inside &= d >= 0;
+        }
+        result[i] = inside;
+    }
+#endif
+}
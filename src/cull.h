@@ -0,0 +1,21 @@
+#ifndef _cull_h_
+#define _cull_h_
+
+/* axis-aligned boxes, one array per bound and axis so they can be tested
+ * a batch at a time; arrays are padded out to a whole batch */
+typedef struct {
+    int count;
+    int capacity;
+    float *lo[3];
+    float *hi[3];
+} CullBoxes;
+
+void cull_clear(CullBoxes *boxes);
+void cull_free(CullBoxes *boxes);
+int cull_add(
+    CullBoxes *boxes, float x0, float y0, float z0,
+    float x1, float y1, float z1);
+int cull_box(float planes[6][4], const float lo[3], const float hi[3]);
+void cull_test(CullBoxes *boxes, float planes[6][4], char *result);
+
+#endif
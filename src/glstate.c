@@ -0,0 +1,94 @@
+#include <string.h>
+#include "glstate.h"
+
+#define GLSTATE_UNIFORMS 64
+
+/* a program keeps its uniforms while others are in use, so values are
+ * remembered per program and location */
+typedef struct {
+    GLuint program;
+    GLint location;
+    unsigned char value[sizeof(GLfloat) * 16];
+} GlstateUniform;
+
+static GLuint program_in_use = 0;
+static GLuint vertex_array = 0;
+static GlstateUniform uniforms[GLSTATE_UNIFORMS];
+static int uniform_count = 0;
+
+void glstate_use_program(GLuint program) {
+    if (program != program_in_use) {
+        glUseProgram(program);
+        program_in_use = program;
+    }
+}
+
+void glstate_bind_vertex_array(GLuint vao) {
+    if (vao != vertex_array) {
+        glBindVertexArray(vao);
+        vertex_array = vao;
+    }
+}
+
+/* deleting the bound array unbinds it, and its name may come back */
+void glstate_delete_vertex_array(GLuint vao) {
+    glDeleteVertexArrays(1, &vao);
+    if (vao == vertex_array) {
+        vertex_array = 0;
+    }
+}
+
+/* whether the program in use last had something else at location,
+ * remembering value for next time; uniforms past the table are always
+ * sent */
+static int uniform_changed(GLint location, const void *value, size_t size) {
+    if (location < 0) {
+        return 0;
+    }
+    GlstateUniform *uniform = 0;
+    for (int i = 0; i < uniform_count; i++) {
+        if (uniforms[i].program == program_in_use &&
+            uniforms[i].location == location)
+        {
+            uniform = uniforms + i;
+            break;
+        }
+    }
+    if (uniform && memcmp(uniform->value, value, size) == 0) {
+        return 0;
+    }
+    if (!uniform && uniform_count < GLSTATE_UNIFORMS) {
+        uniform = uniforms + uniform_count++;
+        uniform->program = program_in_use;
+        uniform->location = location;
+    }
+    if (uniform) {
+        memcpy(uniform->value, value, size);
+    }
+    return 1;
+}
+
+void glstate_uniform1i(GLint location, GLint value) {
+    if (uniform_changed(location, &value, sizeof(value))) {
+        glUniform1i(location, value);
+    }
+}
+
+void glstate_uniform1f(GLint location, GLfloat value) {
+    if (uniform_changed(location, &value, sizeof(value))) {
+        glUniform1f(location, value);
+    }
+}
+
+void glstate_uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat value[3] = {x, y, z};
+    if (uniform_changed(location, value, sizeof(value))) {
+        glUniform3fv(location, 1, value);
+    }
+}
+
+void glstate_uniform_matrix4(GLint location, const GLfloat *value) {
+    if (uniform_changed(location, value, sizeof(GLfloat) * 16)) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, value);
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef _glstate_h_
+#define _glstate_h_
+
+#include <GL/glew.h>
+
+/* gl state that is only sent when it changes. once used, programs and
+ * vertex arrays must be switched and deleted only through here */
+void glstate_use_program(GLuint program);
+void glstate_bind_vertex_array(GLuint vao);
+void glstate_delete_vertex_array(GLuint vao);
+void glstate_uniform1i(GLint location, GLint value);
+void glstate_uniform1f(GLint location, GLfloat value);
+void glstate_uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+void glstate_uniform_matrix4(GLint location, const GLfloat *value);
+
+#endif
@@ -189,6 +189,17 @@ int is_transparent(int w) {
     }
 }
 
+/* see-through blocks whose texels are either there or not */
+int is_cutout(int w) {
+    w = ABS(w);
+    return is_plant(w) || w == LEAVES;
+}
+
+/* see-through blocks that are blended over what's behind them */
+int is_translucent(int w) {
+    return ABS(w) == GLASS;
+}
+
 int is_destructable(int w) {
     switch (w) {
         case EMPTY:
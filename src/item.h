@@ -66,6 +66,8 @@ extern const int plants[256];
 int is_plant(int w);
 int is_obstacle(int w);
 int is_transparent(int w);
+int is_cutout(int w);
+int is_translucent(int w);
 int is_destructable(int w);
 
 #endif
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lz.h"
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+#define HASH_BITS 12
+
+static unsigned int read32(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int hash32(unsigned int v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static unsigned char *write_length(
+    unsigned char *op, unsigned char *oend, int length)
+{
+    while (length >= 255) {
+        if (op >= oend) return 0;
+        *(op++) = 255;
+        length -= 255;
+    }
+    if (op >= oend) return 0;
+    *(op++) = length;
+    return op;
+}
+
+/* emits one sequence; a negative offset emits the final literals only */
+static unsigned char *write_sequence(
+    unsigned char *op, unsigned char *oend,
+    const unsigned char *literals, int literal_length,
+    int offset, int match_length)
+{
+    if (op >= oend) return 0;
+    unsigned char *token = op++;
+    int ml = match_length - MIN_MATCH;
+    *token = (literal_length < 15 ? literal_length : 15) << 4;
+    if (literal_length >= 15) {
+        if (!(op = write_length(op, oend, literal_length - 15))) return 0;
+    }
+    if (oend - op < literal_length) return 0;
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+    if (offset < 0) {
+        return op;
+    }
+    if (oend - op < 2) return 0;
+    *(op++) = offset & 0xff;
+    *(op++) = offset >> 8;
+    *token |= ml < 15 ? ml : 15;
+    if (ml >= 15) {
+        if (!(op = write_length(op, oend, ml - 15))) return 0;
+    }
+    return op;
+}
+
+int lz_compress(
+    const unsigned char *src, int src_size,
+    unsigned char *dst, int dst_capacity,
+    const unsigned char *dict, int dict_size)
+{
+    /* work on dict + src as one buffer so matches can cross into it */
+    if (dict_size > MAX_OFFSET) {
+        dict += dict_size - MAX_OFFSET;
+        dict_size = MAX_OFFSET;
+    }
+    int total = dict_size + src_size;
+    unsigned char *base = malloc(total);
+    int *table = malloc(sizeof(int) << HASH_BITS);
+    memcpy(base, dict, dict_size);
+    memcpy(base + dict_size, src, src_size);
+    for (int i = 0; i < 1 << HASH_BITS; i++) {
+        table[i] = -1;
+    }
+    for (int i = 0; i + MIN_MATCH <= dict_size; i++) {
+        table[hash32(read32(base + i))] = i;
+    }
+    unsigned char *op = dst;
+    unsigned char *oend = dst + dst_capacity;
+    int ip = dict_size;
+    int anchor = ip;
+    int mflimit = total - MF_LIMIT;
+    int matchlimit = total - LAST_LITERALS;
+    while (op && ip < mflimit) {
+        unsigned int sequence = read32(base + ip);
+        int h = hash32(sequence);
+        int ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > MAX_OFFSET ||
+            read32(base + ref) != sequence)
+        {
+            ip++;
+            continue;
+        }
+        int length = MIN_MATCH;
+        while (ip + length < matchlimit && base[ref + length] == base[ip + length]) {
+            length++;
+        }
+        op = write_sequence(
+            op, oend, base + anchor, ip - anchor, ip - ref, length);
+        ip += length;
+        anchor = ip;
+        if (ip < mflimit) {
+            table[hash32(read32(base + ip - 2))] = ip - 2;
+        }
+    }
+    if (op) {
+        op = write_sequence(op, oend, base + anchor, total - anchor, -1, 0);
+    }
+    free(table);
+    free(base);
+    return op ? op - dst : 0;
+}
+
+int lz_decompress(
+    const unsigned char *src, int src_size,
+    unsigned char *dst, int dst_capacity,
+    const unsigned char *dict, int dict_size)
+{
+    const unsigned char *ip = src;
+    const unsigned char *iend = src + src_size;
+    unsigned char *op = dst;
+    unsigned char *oend = dst + dst_capacity;
+    while (ip < iend) {
+        int token = *(ip++);
+        int length = token >> 4;
+        if (length == 15) {
+            int s;
+            do {
+                if (ip >= iend) return -1;
+                s = *(ip++);
+                length += s;
+            } while (s == 255);
+        }
+        if (iend - ip < length || oend - op < length) return -1;
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+        if (ip >= iend) {
+            break;
+        }
+        if (iend - ip < 2) return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        length = (token & 15) + MIN_MATCH;
+        if ((token & 15) == 15) {
+            int s;
+            do {
+                if (ip >= iend) return -1;
+                s = *(ip++);
+                length += s;
+            } while (s == 255);
+        }
+        int produced = op - dst;
+        if (offset == 0 || offset > produced + dict_size) return -1;
+        if (oend - op < length) return -1;
+        if (offset > produced) {
+            /* starts in the dictionary, may continue into the output */
+            int from = dict_size - (offset - produced);
+            int n = dict_size - from;
+            n = n < length ? n : length;
+            memcpy(op, dict + from, n);
+            op += n;
+            length -= n;
+        }
+        const unsigned char *match = op - offset;
+        if (offset == 1) {
+            memset(op, *match, length);
+            op += length;
+        }
+        else {
+            /* overlapping copies repeat the pattern, doubling each time */
+            while (length > 0) {
+                int n = op - match < length ? op - match : length;
+                memcpy(op, match, n);
+                op += n;
+                length -= n;
+            }
+        }
+    }
+    return op - dst;
+}
@@ -0,0 +1,20 @@
+#ifndef _lz_h_
+#define _lz_h_
+
+/* A small codec for the LZ4 block format, with optional external
+ * dictionary: the dictionary acts as history preceding the data, so
+ * matches may reach back into it. Both sides must use the same one. */
+
+#define LZ_BOUND(size) ((size) + (size) / 255 + 16)
+
+int lz_compress(
+    const unsigned char *src, int src_size,
+    unsigned char *dst, int dst_capacity,
+    const unsigned char *dict, int dict_size);
+
+int lz_decompress(
+    const unsigned char *src, int src_size,
+    unsigned char *dst, int dst_capacity,
+    const unsigned char *dict, int dict_size);
+
+#endif
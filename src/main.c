@@ -6,14 +6,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "atlas.h"
+#include "cache.h"
 #include "client.h"
+#include "codec.h"
 #include "config.h"
 #include "cube.h"
+#include "cull.h"
+#include "glstate.h"
 #include "item.h"
 #include "map.h"
 #include "matrix.h"
-#include "miniz.h"
+#include "pool.h"
+#include "profile.h"
 #include "tinycthread.h"
+#include "trace.h"
 #include "util.h"
 
 #define MAX_CHUNKS (MAX_CHUNK_COUNT * 10 / 5) /* divide by the max load factor */
@@ -29,6 +36,52 @@
 #define ALIGN_CENTER 1
 #define ALIGN_RIGHT 2
 
+#define EDIT_NX 0x01
+#define EDIT_PX 0x02
+#define EDIT_NY 0x04
+#define EDIT_PY 0x08
+#define EDIT_NZ 0x10
+#define EDIT_PZ 0x20
+#define EDIT_ALL 0x3f
+#define EDIT_SELF 0x40
+/* the same sides again, for edits light may carry across */
+#define EDIT_LIGHT_SHIFT 8
+#define EDIT_LIGHTS (EDIT_ALL << EDIT_LIGHT_SHIFT)
+#define LIGHT_REACH 15
+
+/* sides of a chunk, in the same order as the EDIT_ bits; a side's
+ * opposite is side ^ 1 */
+#define SIDE_NX 0
+#define SIDE_PX 1
+#define SIDE_NY 2
+#define SIDE_PY 3
+#define SIDE_NZ 4
+#define SIDE_PZ 5
+#define SIDES 6
+#define SIDES_ALL 0x3f
+#define CONNECTIONS_ALL 0x7fff
+#define SIDES_REACHED 0x40
+
+/* a chunk's mesh is laid out as one group of opaque faces per side they
+ * point to, then the cutout faces and the translucent ones, each drawn
+ * in a pass of its own */
+#define GROUP_CUTOUT SIDES
+#define GROUP_TRANSLUCENT (SIDES + 1)
+#define GROUPS (SIDES + 2)
+
+/* displaced corners tilt a face by up to 0.15 over 0.7 of a block */
+#define FACE_SLANT 0.25
+
+/* meshes kept per chunk: full detail, then 2, 4 and 8 blocks a cell */
+#define LODS 4
+
+/* far chunks are drawn in regions of 4x4x4 chunks, one mesh each at the
+ * level they'd be drawn at themselves; regions live in a grid that wraps
+ * around, wide enough that two loaded ones never share a slot */
+#define REGION_SIZE 4
+#define REGION_LOD 2
+#define REGION_SLOTS 16
+
 #define WORKER_IDLE 0
 #define WORKER_BUSY 1
 #define WORKER_DONE 2
@@ -47,10 +100,19 @@ typedef struct {
     int q;
     int r;
     int dirty;
+    int edits;
     int miny;
     int maxy;
     int faces;
-    GLuint buffer;
+    int groups[LODS][GROUPS];
+    unsigned int version;
+    double requested;
+    double received;
+    int meshed;
+    int openings;
+    int connections;
+    int lods;
+    PoolRange ranges[LODS];
 } Chunk;
 
 typedef struct {
@@ -58,14 +120,38 @@ typedef struct {
     int q;
     int r;
     int load;
+    int lods;
+    int coarse;
     Chunk *chunks[3][3][3];
     Map *light_maps[3][3][3];
     int miny;
     int maxy;
     int faces;
-    GLfloat *data;
+    int groups[LODS][GROUPS];
+    int openings;
+    int connections;
+    GLfloat *data[LODS];
+    double queued;
+    int region;
+    int version;
+    Chunk *members[REGION_SIZE][REGION_SIZE][REGION_SIZE];
 } WorkerItem;
 
+/* changes counts member remeshes; built is the count the mesh was made
+ * at, so the mesh is current when the two match */
+typedef struct {
+    int p;
+    int q;
+    int r;
+    int valid;
+    int changes;
+    int built;
+    int pending;
+    int drawn;
+    int groups[GROUPS];
+    PoolRange range;
+} Region;
+
 typedef struct {
     int index;
     int state;
@@ -97,7 +183,6 @@ typedef struct {
     State state;
     State state1;
     State state2;
-    GLuint buffer;
 } Player;
 
 typedef struct {
@@ -105,6 +190,9 @@ typedef struct {
     GLuint position;
     GLuint normal;
     GLuint uv;
+    GLuint from;
+    GLuint to;
+    GLuint angles;
     GLuint matrix;
     GLuint sampler;
     GLuint camera;
@@ -115,11 +203,59 @@ typedef struct {
     GLuint extra4;
 } Attrib;
 
+typedef struct {
+    double start;
+    double since;
+    double parse_time;
+    double since_parse_time;
+    int received;
+    int meshed;
+    int since_received;
+    int since_meshed;
+    int max_backlog;
+    double network_latency;
+    double max_network_latency;
+    int network_count;
+    double mesh_latency;
+    double max_mesh_latency;
+    int mesh_count;
+    double max_frame;
+} Stats;
+
 typedef struct {
     GLFWwindow *window;
     Worker workers[WORKERS];
     Chunk chunks[MAX_CHUNKS];
     int chunk_count;
+    Region regions[REGION_SLOTS * REGION_SLOTS * REGION_SLOTS];
+    int region_frame;
+    CullBoxes cull_boxes;
+    int cull_p;
+    int cull_q;
+    int cull_r;
+    int cull_radius;
+    unsigned short *order_keys;
+    int order_buckets;
+    int order_p;
+    int order_q;
+    int order_r;
+    int order_radius;
+    GLfloat *hud_lines;
+    int hud_line_count;
+    int hud_line_capacity;
+    GLfloat *hud_text;
+    int hud_text_count;
+    int hud_text_capacity;
+    GLuint hud_buffer;
+    GLuint hud_line_vao;
+    GLuint hud_text_vao;
+    int players_changed;
+    int player_instance_count;
+    GLuint player_buffer;
+    GLuint player_instances;
+    GLuint player_vao;
+    int dirty_list[MAX_CHUNK_COUNT][3];
+    int dirty_count;
     int create_radius;
     int render_radius;
     int delete_radius;
@@ -141,6 +277,12 @@ typedef struct {
     int server_port;
     int day_length;
     int time_changed;
+    int codec;
+    int replaying;
+    int headless;
+    int show_profile;
+    double time_base;
+    Stats stats;
 } Model;
 
 static Model model;
@@ -150,12 +292,21 @@ static int chunked(float x) {
     return floorf(roundf(x) / CHUNK_SIZE);
 }
 
+/* seconds on the day clock, which the server sets with E */
+static double get_time() {
+    return get_clock() - g->time_base;
+}
+
+static void set_time(double t) {
+    g->time_base = get_clock() - t;
+}
+
 static float time_of_day() {
     if (g->day_length <= 0) {
         return 0.5;
     }
     float t;
-    t = glfwGetTime();
+    t = get_time();
     t = t / g->day_length;
     t = t - (int)t;
     return t;
@@ -209,62 +360,30 @@ static void get_motion_vector(int flying, int sz, int sx, float rx, float ry,
     }
 }
 
-static GLuint gen_crosshair_buffer() {
-    int x = g->width / 2;
-    int y = g->height / 2;
-    int p = 10 * g->scale;
-    float data[] = {
-        x, y - p, x, y + p,
-        x - p, y, x + p, y
-    };
-    return gen_buffer(sizeof(data), data);
-}
-
-static GLuint gen_player_buffer(float x, float y, float z, float rx, float ry) {
-    GLfloat *data = malloc_faces(10, 6);
-    make_player(data, x, y, z, rx, ry);
-    return gen_faces(10, 6, data);
-}
-
-static GLuint gen_text_buffer(float x, float y, float n, char *text) {
-    int length = strlen(text);
-    GLfloat *data = malloc_faces(4, length);
-    for (int i = 0; i < length; i++) {
-        make_character(data + i * 24, x, y, n / 2, n, text[i]);
-        x += n;
-    }
-    return gen_faces(4, length, data);
-}
-
-static void draw_triangles_2d(Attrib *attrib, GLuint buffer, int count) {
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glEnableVertexAttribArray(attrib->position);
-    glEnableVertexAttribArray(attrib->uv);
-    glVertexAttribPointer(attrib->position, 2, GL_FLOAT, GL_FALSE,
-        sizeof(GLfloat) * 4, 0);
-    glVertexAttribPointer(attrib->uv, 2, GL_FLOAT, GL_FALSE,
-        sizeof(GLfloat) * 4, (GLvoid *)(sizeof(GLfloat) * 2));
-    glDrawArrays(GL_TRIANGLES, 0, count);
-    glDisableVertexAttribArray(attrib->position);
-    glDisableVertexAttribArray(attrib->uv);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
-
-static void draw_lines(Attrib *attrib, GLuint buffer, int components, int count) {
+/* a vertex array over buffer for a 2d format: positions, or positions
+ * and uvs interleaved */
+static GLuint gen_vao_2d(Attrib *attrib, GLuint buffer, int uvs) {
+    GLuint vao;
+    GLsizei stride = sizeof(GLfloat) * (uvs ? 4 : 2);
+    glGenVertexArrays(1, &vao);
+    glstate_bind_vertex_array(vao);
     glBindBuffer(GL_ARRAY_BUFFER, buffer);
     glEnableVertexAttribArray(attrib->position);
     glVertexAttribPointer(
-        attrib->position, components, GL_FLOAT, GL_FALSE, 0, 0);
-    glDrawArrays(GL_LINES, 0, count);
-    glDisableVertexAttribArray(attrib->position);
+        attrib->position, 2, GL_FLOAT, GL_FALSE, stride, 0);
+    if (uvs) {
+        glEnableVertexAttribArray(attrib->uv);
+        glVertexAttribPointer(attrib->uv, 2, GL_FLOAT, GL_FALSE,
+            stride, (GLvoid *)(sizeof(GLfloat) * 2));
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vao;
 }
 
-static void draw_text(Attrib *attrib, GLuint buffer, int length) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    draw_triangles_2d(attrib, buffer, length * 6);
-    glDisable(GL_BLEND);
+static void draw_arrays(GLuint vao, GLenum mode, int first, int count) {
+    glstate_bind_vertex_array(vao);
+    glDrawArrays(mode, first, count);
+    profile_count(PROFILE_DRAWS, 1);
 }
 
 static Player *find_player(int id) {
@@ -285,40 +404,52 @@ static void update_player(Player *player,
         State *s2 = &player->state2;
         memcpy(s1, s2, sizeof(State));
         s2->x = x; s2->y = y; s2->z = z; s2->rx = rx; s2->ry = ry;
-        s2->t = glfwGetTime();
+        s2->t = get_time();
         if (s2->rx - s1->rx > PI) {
             s1->rx += 2 * PI;
         }
         if (s1->rx - s2->rx > PI) {
             s1->rx -= 2 * PI;
         }
+        g->players_changed = 1;
     }
     else {
         State *s = &player->state;
         s->x = x; s->y = y; s->z = z; s->rx = rx; s->ry = ry;
-        del_buffer(player->buffer);
-        player->buffer = gen_player_buffer(s->x, s->y, s->z, s->rx, s->ry);
     }
 }
 
+/* sets a player's state to where it is between its last two updates,
+ * as the player shader places it */
+static void interpolate_player(Player *player) {
+    State *s1 = &player->state1;
+    State *s2 = &player->state2;
+    float span = MAX(MIN(s2->t - s1->t, 1), 0.1);
+    float p = MAX(MIN((get_time() - s2->t) / span, 1), 0);
+    update_player(player,
+        s1->x + (s2->x - s1->x) * p,
+        s1->y + (s2->y - s1->y) * p,
+        s1->z + (s2->z - s1->z) * p,
+        s1->rx + (s2->rx - s1->rx) * p,
+        s1->ry + (s2->ry - s1->ry) * p,
+        0);
+}
+
 static void delete_player(int id) {
     Player *player = find_player(id);
     if (!player) {
         return;
     }
     int count = g->player_count;
-    del_buffer(player->buffer);
     Player *other = g->players + (--count);
     memcpy(player, other, sizeof(Player));
     g->player_count = count;
+    g->players_changed = 1;
 }
 
 static void delete_all_players() {
-    for (int i = 0; i < g->player_count; i++) {
-        Player *player = g->players + i;
-        del_buffer(player->buffer);
-    }
     g->player_count = 0;
+    g->players_changed = 1;
 }
 
 static float player_player_distance(Player *p1, Player *p2) {
@@ -354,6 +485,7 @@ static Player *player_crosshair(Player *player) {
         if (other == player) {
             continue;
         }
+        interpolate_player(other);
         float p = player_crosshair_distance(player, other);
         float d = player_player_distance(player, other);
         if (d < 96 && p / d < threshold) {
@@ -427,46 +559,45 @@ static int chunk_distance(Chunk *chunk, int p, int q, int r) {
     return MAX(MAX(dp, dq), dr);
 }
 
-static int chunk_visible(float planes[6][4], int p, int q, int r) {
-    int x = p * CHUNK_SIZE - 1;
-    int y = q * CHUNK_SIZE - 1;
-    int z = r * CHUNK_SIZE - 1;
-    int d = CHUNK_SIZE + 1;
-    float points[8][3] = {
-        {x + 0, y + 0, z + 0},
-        {x + d, y + 0, z + 0},
-        {x + 0, y + 0, z + d},
-        {x + d, y + 0, z + d},
-        {x + 0, y + d, z + 0},
-        {x + d, y + d, z + 0},
-        {x + 0, y + d, z + d},
-        {x + d, y + d, z + d}
-    };
-    int n = 6;
-    for (int i = 0; i < n; i++) {
-        int in = 0;
-        int out = 0;
-        for (int j = 0; j < 8; j++) {
-            float d =
-                planes[i][0] * points[j][0] +
-                planes[i][1] * points[j][1] +
-                planes[i][2] * points[j][2] +
-                planes[i][3];
-            if (d < 0) {
-                out++;
-            }
-            else {
-                in++;
-            }
-            if (in && out) {
-                break;
+/* how many levels of detail to mesh a chunk with: just the finest when
+ * it's too near to be drawn coarser, or there's nothing to draw with;
+ * otherwise all, from a chunk before the first coarse one is needed */
+static int chunk_levels(Chunk *chunk, int p, int q, int r) {
+    if (g->headless || chunk_distance(chunk, p, q, r) < LOD_DISTANCE - 1) {
+        return 1;
+    }
+    return LODS;
+}
+
+/* tests every chunk within radius of p, q, r against the frustum in one
+ * go, into a grid indexed (q, p, r) from the lowest corner. the boxes
+ * are kept until the centre or radius changes */
+static void cull_chunks(
+    float planes[6][4], int p, int q, int r, int radius, char *result)
+{
+    CullBoxes *boxes = &g->cull_boxes;
+    int size = radius * 2 + 1;
+    if (boxes->count != size * size * size || g->cull_p != p ||
+        g->cull_q != q || g->cull_r != r || g->cull_radius != radius)
+    {
+        cull_clear(boxes);
+        for (int dq = -radius; dq <= radius; dq++) {
+            for (int dp = -radius; dp <= radius; dp++) {
+                for (int dr = -radius; dr <= radius; dr++) {
+                    int x = (p + dp) * CHUNK_SIZE - 1;
+                    int y = (q + dq) * CHUNK_SIZE - 1;
+                    int z = (r + dr) * CHUNK_SIZE - 1;
+                    int d = CHUNK_SIZE + 1;
+                    cull_add(boxes, x, y, z, x + d, y + d, z + d);
+                }
             }
         }
-        if (in == 0) {
-            return 0;
-        }
+        g->cull_p = p;
+        g->cull_q = q;
+        g->cull_r = r;
+        g->cull_radius = radius;
     }
-    return 1;
+    cull_test(boxes, planes, result);
 }
 
 static int highest_block(float x, float z) {
@@ -591,18 +722,112 @@ static int player_intersects_block(
     return 0;
 }
 
-static void dirty_chunk(Chunk *chunk) {
-    chunk->dirty = 1;
-    for (int dp = -1; dp <= 1; dp++) {
-        for (int dq = -1; dq <= 1; dq++) {
-            for (int dr = -1; dr <= 1; dr++) {
-                Chunk *other = find_chunk(chunk->p + dp, chunk->q + dq, chunk->r + dr);
-                if (other) {
-                    other->dirty = 1;
+static int edit_mask(int d, int nbit, int pbit, int faces) {
+    if (d < 0) return faces & nbit;
+    if (d > 0) return faces & pbit;
+    return 1;
+}
+
+/* marks every chunk queued for itself since the last flush as dirty,
+ * along with its neighbours on the queued sides. neighbours only light
+ * can carry an edit to are included when either chunk has lights */
+static void flush_dirty_chunks() {
+    for (int i = 0; i < g->dirty_count; i++) {
+        int *c = g->dirty_list[i];
+        Chunk *chunk = find_chunk(c[0], c[1], c[2]);
+        if (!chunk || !chunk->edits) {
+            continue;
+        }
+        int faces = chunk->edits;
+        int lights = SHOW_LIGHTS ? faces >> EDIT_LIGHT_SHIFT : 0;
+        chunk->edits = 0;
+        if (faces & EDIT_SELF) {
+            chunk->dirty = 1;
+        }
+        for (int dp = -1; dp <= 1; dp++) {
+            for (int dq = -1; dq <= 1; dq++) {
+                for (int dr = -1; dr <= 1; dr++) {
+                    if (!dp && !dq && !dr) {
+                        continue;
+                    }
+                    int border =
+                        edit_mask(dp, EDIT_NX, EDIT_PX, faces) &&
+                        edit_mask(dq, EDIT_NY, EDIT_PY, faces) &&
+                        edit_mask(dr, EDIT_NZ, EDIT_PZ, faces);
+                    int reach =
+                        edit_mask(dp, EDIT_NX, EDIT_PX, lights) &&
+                        edit_mask(dq, EDIT_NY, EDIT_PY, lights) &&
+                        edit_mask(dr, EDIT_NZ, EDIT_PZ, lights);
+                    if (!border && !reach) {
+                        continue;
+                    }
+                    Chunk *other = find_chunk(chunk->p + dp, chunk->q + dq, chunk->r + dr);
+                    if (other && (border ||
+                        chunk->lights.size || other->lights.size))
+                    {
+                        other->dirty = 1;
+                    }
                 }
             }
         }
     }
+    g->dirty_count = 0;
+}
+
+static void queue_edits(Chunk *chunk, int edits) {
+    if (!chunk->edits) {
+        if (g->dirty_count == MAX_CHUNK_COUNT) {
+            flush_dirty_chunks();
+        }
+        int *c = g->dirty_list[g->dirty_count++];
+        c[0] = chunk->p;
+        c[1] = chunk->q;
+        c[2] = chunk->r;
+    }
+    chunk->edits |= edits;
+}
+
+/* queues the chunk to be remeshed at the next flush, along with the
+ * neighbours on the sides given by faces */
+static void dirty_faces(Chunk *chunk, int faces) {
+    queue_edits(chunk, EDIT_SELF | faces);
+}
+
+static void dirty_chunk(Chunk *chunk) {
+    dirty_faces(chunk, EDIT_ALL | EDIT_LIGHTS);
+}
+
+/* sides of the chunk whose neighbours' meshes can see the block at (x, y, z),
+ * as ambient shading looks up to 8 blocks above a face, and in the
+ * EDIT_LIGHTS bits the sides within LIGHT_REACH of it */
+static int block_faces(int x, int y, int z) {
+    int lx = mod_euc(x, CHUNK_SIZE);
+    int ly = mod_euc(y, CHUNK_SIZE);
+    int lz = mod_euc(z, CHUNK_SIZE);
+    int faces = 0;
+    if (lx == 0) faces |= EDIT_NX;
+    if (lx == CHUNK_SIZE - 1) faces |= EDIT_PX;
+    if (ly < 8) faces |= EDIT_NY;
+    if (ly == CHUNK_SIZE - 1) faces |= EDIT_PY;
+    if (lz == 0) faces |= EDIT_NZ;
+    if (lz == CHUNK_SIZE - 1) faces |= EDIT_PZ;
+    int reach = 0;
+    if (lx < LIGHT_REACH) reach |= EDIT_NX;
+    if (lx >= CHUNK_SIZE - LIGHT_REACH) reach |= EDIT_PX;
+    if (ly < LIGHT_REACH) reach |= EDIT_NY;
+    if (ly >= CHUNK_SIZE - LIGHT_REACH) reach |= EDIT_PY;
+    if (lz < LIGHT_REACH) reach |= EDIT_NZ;
+    if (lz >= CHUNK_SIZE - LIGHT_REACH) reach |= EDIT_PZ;
+    return faces | reach << EDIT_LIGHT_SHIFT;
+}
+
+static void dirty_block(Chunk *chunk, int x, int y, int z) {
+    dirty_faces(chunk, block_faces(x, y, z));
+}
+
+/* a light changes the meshes of every neighbour it reaches, lit or not */
+static void dirty_light(Chunk *chunk, int x, int y, int z) {
+    dirty_faces(chunk, block_faces(x, y, z) >> EDIT_LIGHT_SHIFT);
 }
 
 static void occlusion(
@@ -680,6 +905,320 @@ static void light_fill(
     light_fill(opaque, light, x, y, z + 1, w, 0);
 }
 
+/* the side each of make_cube's faces points to, in the order it makes
+ * them */
+static const int cube_sides[6] = {
+    SIDE_NX, SIDE_PX, SIDE_PY, SIDE_NY, SIDE_NZ, SIDE_PZ
+};
+
+/* the group a block's faces go to, or -1 if they go by side */
+static int block_group(int w) {
+    if (is_cutout(w)) {
+        return GROUP_CUTOUT;
+    }
+    if (is_translucent(w)) {
+        return GROUP_TRANSLUCENT;
+    }
+    return -1;
+}
+
+/* moves the faces make_cube made in one piece to their groups, which are
+ * by side unless group says otherwise */
+static void place_faces(
+    GLfloat *data, int offsets[GROUPS], int ends[GROUPS],
+    float *cube, int flags[6], int group)
+{
+    float *face = cube;
+    for (int i = 0; i < 6; i++) {
+        if (!flags[i]) {
+            continue;
+        }
+        int to = group < 0 ? cube_sides[i] : group;
+        int *offset = offsets + to;
+        if (*offset + 60 <= ends[to]) { /* HACK FIXME */
+            memcpy(data + *offset, face, sizeof(float) * 60);
+            *offset += 60;
+        }
+        face += 60;
+    }
+}
+
+static GLfloat *alloc_groups(
+    int groups[GROUPS], int offsets[GROUPS], int ends[GROUPS])
+{
+    int faces = 0;
+    for (int i = 0; i < GROUPS; i++) {
+        offsets[i] = faces * 60;
+        faces += groups[i];
+        ends[i] = faces * 60;
+    }
+    return malloc_faces(10, faces);
+}
+
+/* bit for a pair of different sides, one of 15 */
+static int side_pair(int a, int b) {
+    if (a > b) {
+        int t = a; a = b; b = t;
+    }
+    return 1 << (a * (11 - a) / 2 + b - a - 1);
+}
+
+/* flood fills the see-through cells of the middle chunk; sides touched by
+ * the same pocket of them can see each other. returns those pairs, and
+ * the sides touched at all in openings */
+static int chunk_connections(char *opaque, int *openings) {
+    int n = CHUNK_SIZE;
+    int lo = XYZ_LO + 1;
+    char *filled = calloc(n * n * n, sizeof(char));
+    int *stack = malloc(sizeof(int) * n * n * n);
+    int result = 0;
+    *openings = 0;
+    for (int start = 0; start < n * n * n; start++) {
+        int x = start % n, y = start / n % n, z = start / (n * n);
+        if (filled[start] || opaque[XYZ(lo + x, lo + y, lo + z)]) {
+            continue;
+        }
+        int sides = 0;
+        int top = 0;
+        filled[start] = 1;
+        stack[top++] = start;
+        while (top) {
+            int index = stack[--top];
+            x = index % n; y = index / n % n; z = index / (n * n);
+            int neighbors[SIDES] = {
+                x > 0 ? index - 1 : -1,
+                x < n - 1 ? index + 1 : -1,
+                y > 0 ? index - n : -1,
+                y < n - 1 ? index + n : -1,
+                z > 0 ? index - n * n : -1,
+                z < n - 1 ? index + n * n : -1
+            };
+            for (int side = 0; side < SIDES; side++) {
+                int other = neighbors[side];
+                if (other < 0) {
+                    sides |= 1 << side;
+                    continue;
+                }
+                if (filled[other]) {
+                    continue;
+                }
+                int ox = other % n, oy = other / n % n, oz = other / (n * n);
+                if (!opaque[XYZ(lo + ox, lo + oy, lo + oz)]) {
+                    filled[other] = 1;
+                    stack[top++] = other;
+                }
+            }
+        }
+        *openings |= sides;
+        for (int a = 0; a < SIDES; a++) {
+            for (int b = a + 1; b < SIDES; b++) {
+                if ((sides >> a & 1) && (sides >> b & 1)) {
+                    result |= side_pair(a, b);
+                }
+            }
+        }
+    }
+    free(filled);
+    free(stack);
+    return result;
+}
+
+/* halves a cube of cells on each axis; a cell is solid if any of the
+ * eight under it is, and takes the block of the highest of them */
+static void downsample(const char *fine, int n, char *coarse) {
+    int m = n / 2;
+    for (int x = 0; x < m; x++) {
+        for (int y = 0; y < m; y++) {
+            for (int z = 0; z < m; z++) {
+                int w = 0;
+                for (int dy = 1; dy >= 0 && !w; dy--) {
+                    for (int dx = 0; dx < 2 && !w; dx++) {
+                        for (int dz = 0; dz < 2 && !w; dz++) {
+                            int a = x * 2 + dx, b = y * 2 + dy, c = z * 2 + dz;
+                            w = fine[a + b * n + c * n * n];
+                        }
+                    }
+                }
+                coarse[x + y * m + z * m * m] = w;
+            }
+        }
+    }
+}
+
+#define CELL(x, y, z) cells[(x) + (y) * n + (z) * n * n]
+
+/* meshes a cube of n cells, each scale blocks wide, from x, y, z. faces
+ * on its sides are always made, whatever is beyond them */
+static GLfloat *mesh_cells(
+    const char *cells, int n, int scale, int x0, int y0, int z0,
+    int groups[GROUPS])
+{
+    float ao[6][4] = {{0}};
+    float light[6][4] = {{0}};
+    int offsets[GROUPS];
+    int ends[GROUPS];
+    GLfloat *data = 0;
+    memset(groups, 0, sizeof(int) * GROUPS);
+    /* once to count the faces, once to make them */
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass) {
+            data = alloc_groups(groups, offsets, ends);
+        }
+        for (int x = 0; x < n; x++) {
+            for (int y = 0; y < n; y++) {
+                for (int z = 0; z < n; z++) {
+                    int w = CELL(x, y, z);
+                    if (!w) {
+                        continue;
+                    }
+                    int ex = x0 + x * scale;
+                    int ey = y0 + y * scale;
+                    int ez = z0 + z * scale;
+                    int flags[6] = {
+                        x == 0 || !CELL(x - 1, y, z),
+                        x == n - 1 || !CELL(x + 1, y, z),
+                        y == n - 1 || !CELL(x, y + 1, z),
+                        (y == 0 || !CELL(x, y - 1, z)) && ey > 0,
+                        z == 0 || !CELL(x, y, z - 1),
+                        z == n - 1 || !CELL(x, y, z + 1)
+                    };
+                    if (!pass) {
+                        for (int i = 0; i < 6; i++) {
+                            groups[cube_sides[i]] += flags[i];
+                        }
+                        continue;
+                    }
+                    float cube[6 * 60];
+                    make_cube_faces(
+                        cube, ao, light,
+                        flags[0], flags[1], flags[2],
+                        flags[3], flags[4], flags[5],
+                        blocks[w][0], blocks[w][1], blocks[w][2],
+                        blocks[w][3], blocks[w][4], blocks[w][5],
+                        ex, ey, ez, scale, 0);
+                    place_faces(data, offsets, ends, cube, flags, -1);
+                }
+            }
+        }
+    }
+    return data;
+}
+
+/* meshes the middle chunk coarser for each level after the first, up to
+ * item->lods. every level's cells cover all the blocks of the finer ones,
+ * and with the faces on the chunk's sides always there, chunks drawn at
+ * different levels next to each other leave no cracks between them */
+static void compute_lods(WorkerItem *item) {
+    for (int lod = 1; lod < LODS; lod++) {
+        item->data[lod] = 0;
+        memset(item->groups[lod], 0, sizeof(item->groups[lod]));
+    }
+    if (item->lods < 2) {
+        return;
+    }
+    Chunk *chunk = item->chunks[1][1][1];
+    int n = CHUNK_SIZE;
+    char *cells = malloc(n * n * n);
+    for (int i = 0; i < n * n * n; i++) {
+        int w = chunk->ws[i];
+        cells[i] = is_plant(w) ? 0 : w;
+    }
+    for (int lod = 1; lod < item->lods; lod++) {
+        char *coarse = calloc((n / 2) * (n / 2) * (n / 2), sizeof(char));
+        downsample(cells, n, coarse);
+        free(cells);
+        cells = coarse;
+        n /= 2;
+        item->data[lod] = mesh_cells(
+            cells, n, CHUNK_SIZE / n, item->p * CHUNK_SIZE,
+            item->q * CHUNK_SIZE, item->r * CHUNK_SIZE, item->groups[lod]);
+    }
+    free(cells);
+}
+
+/* meshes a region of chunks at REGION_LOD, as one piece */
+static void compute_region(WorkerItem *item) {
+    int size = CHUNK_SIZE >> REGION_LOD;
+    int n = size * REGION_SIZE;
+    char *region = calloc(n * n * n, sizeof(char));
+    for (int a = 0; a < REGION_SIZE; a++) {
+        for (int b = 0; b < REGION_SIZE; b++) {
+            for (int c = 0; c < REGION_SIZE; c++) {
+                Chunk *chunk = item->members[a][b][c];
+                if (!chunk) {
+                    continue;
+                }
+                int m = CHUNK_SIZE;
+                char *cells = malloc(m * m * m);
+                for (int i = 0; i < m * m * m; i++) {
+                    int w = chunk->ws[i];
+                    cells[i] = is_plant(w) ? 0 : w;
+                }
+                for (; m > size; m /= 2) {
+                    char *coarse = calloc((m / 2) * (m / 2) * (m / 2), 1);
+                    downsample(cells, m, coarse);
+                    free(cells);
+                    cells = coarse;
+                }
+                for (int x = 0; x < m; x++) {
+                    for (int y = 0; y < m; y++) {
+                        for (int z = 0; z < m; z++) {
+                            int i = a * m + x, j = b * m + y, k = c * m + z;
+                            region[i + j * n + k * n * n] =
+                                cells[x + y * m + z * m * m];
+                        }
+                    }
+                }
+                free(cells);
+            }
+        }
+    }
+    int span = CHUNK_SIZE * REGION_SIZE;
+    item->data[0] = mesh_cells(
+        region, n, 1 << REGION_LOD, item->p * span, item->q * span,
+        item->r * span, item->groups[0]);
+    free(region);
+}
+
+#undef CELL
+
+/* a block near the item's chunk, by world position */
+static int item_block(WorkerItem *item, int x, int y, int z) {
+    int a = (x - mod_euc(x, CHUNK_SIZE)) / CHUNK_SIZE - item->p + 1;
+    int b = (y - mod_euc(y, CHUNK_SIZE)) / CHUNK_SIZE - item->q + 1;
+    int c = (z - mod_euc(z, CHUNK_SIZE)) / CHUNK_SIZE - item->r + 1;
+    Chunk *chunk = item->chunks[a][b][c];
+    return chunk ? chunk_get(chunk, x, y, z) : 0;
+}
+
+/* which faces of block w at x, y, z in the opaque array can be seen, in
+ * make_cube's order: those next to a block that isn't opaque, unless it's
+ * the same see-through block, so glass panes and leaves don't show the
+ * faces between them. returns how many there are */
+static int exposed_faces(
+    WorkerItem *item, char *opaque, int x, int y, int z,
+    int ex, int ey, int ez, int w, int flags[6])
+{
+    static const int offsets[6][3] = {
+        {-1, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, -1}, {0, 0, 1}
+    };
+    int total = 0;
+    for (int i = 0; i < 6; i++) {
+        int dx = offsets[i][0], dy = offsets[i][1], dz = offsets[i][2];
+        flags[i] = !opaque[XYZ(x + dx, y + dy, z + dz)];
+        if (flags[i] && is_transparent(w) && !is_plant(w) &&
+            item_block(item, ex + dx, ey + dy, ez + dz) == w)
+        {
+            flags[i] = 0;
+        }
+        if (dy < 0 && ey <= 0) {
+            flags[i] = 0;
+        }
+        total += flags[i];
+    }
+    return total;
+}
+
 static void compute_chunk(WorkerItem *item) {
     char *opaque = (char *)calloc(XYZ_SIZE*XYZ_SIZE*XYZ_SIZE, sizeof(char));
     char *light = (char *)calloc(XYZ_SIZE*XYZ_SIZE*XYZ_SIZE, sizeof(char));
@@ -717,7 +1256,7 @@ static void compute_chunk(WorkerItem *item) {
                     int y = ey - oy;
                     int z = ez - oz;
                     int w = ew;
-                    opaque[XYZ(x, y, z)] = w;
+                    opaque[XYZ(x, y, z)] = !is_transparent(w);
                     if (opaque[XYZ(x, y, z)]) {
                         highest[XZ(x, z)] = MAX(highest[XZ(x, z)], y);
                     }
@@ -748,41 +1287,46 @@ static void compute_chunk(WorkerItem *item) {
 
     Chunk *chunk = item->chunks[1][1][1];
 
-    // count exposed faces
+    // find which sides can see which through the chunk
+    int openings;
+    int connections = chunk_connections(opaque, &openings);
+
+    // count exposed faces, by the side they point to
     int faces = 0;
+    int groups[GROUPS] = {0};
     CHUNK_FOR_EACH(chunk, ex, ey, ez, ew) {
         int x = ex - ox;
         int y = ey - oy;
         int z = ez - oz;
         if (!ew) continue;
-        int f1 = !opaque[XYZ(x - 1, y, z)] ? 1 : 0;
-        int f2 = !opaque[XYZ(x + 1, y, z)] ? 1 : 0;
-        int f3 = !opaque[XYZ(x, y + 1, z)] ? 1 : 0;
-        int f4 = !opaque[XYZ(x, y - 1, z)] && ey > 0 ? 1 : 0;
-        int f5 = !opaque[XYZ(x, y, z - 1)] ? 1 : 0;
-        int f6 = !opaque[XYZ(x, y, z + 1)] ? 1 : 0;
-        int total = f1 + f2 + f3 + f4 + f5 + f6;
+        int flags[6];
+        int total = exposed_faces(
+            item, opaque, x, y, z, ex, ey, ez, ew, flags);
         if (total == 0)
             continue;
-        if (is_plant(ew))
-            total = 4;
+        if (is_plant(ew)) {
+            groups[GROUP_CUTOUT] += 4;
+            faces += 4;
+            continue;
+        }
+        int group = block_group(ew);
+        for (int i = 0; i < 6; i++) {
+            groups[group < 0 ? cube_sides[i] : group] += flags[i];
+        }
         faces += total;
     }
 
-    GLfloat *data = malloc_faces(10, faces);
-    int offset = 0;
+    int offsets[GROUPS];
+    int ends[GROUPS];
+    GLfloat *data = alloc_groups(groups, offsets, ends);
     CHUNK_FOR_EACH(chunk, ex, ey, ez, ew) {
         int x = ex - ox;
         int y = ey - oy;
         int z = ez - oz;
         if (!ew) continue;
-        int f1 = !opaque[XYZ(x - 1, y, z)] ? 1 : 0;
-        int f2 = !opaque[XYZ(x + 1, y, z)] ? 1 : 0;
-        int f3 = !opaque[XYZ(x, y + 1, z)] ? 1 : 0;
-        int f4 = !opaque[XYZ(x, y - 1, z)] && ey > 0 ? 1 : 0;
-        int f5 = !opaque[XYZ(x, y, z - 1)] ? 1 : 0;
-        int f6 = !opaque[XYZ(x, y, z + 1)] ? 1 : 0;
-        int total = f1 + f2 + f3 + f4 + f5 + f6;
+        int flags[6];
+        int total = exposed_faces(
+            item, opaque, x, y, z, ex, ey, ez, ew, flags);
         if (total == 0)
             continue;
         char neighbors[27] = {0};
@@ -821,42 +1365,178 @@ static void compute_chunk(WorkerItem *item) {
                 }
             }
             float rotation = abs(ex * 323 + ez * -845) % 360;
-            if (offset + total * 60 > faces * 60) continue; /* HACK FIXME */
+            int *offset = offsets + GROUP_CUTOUT;
+            if (*offset + total * 60 > ends[GROUP_CUTOUT]) continue; /* HACK FIXME */
             make_plant(
-                data + offset, min_ao, max_light,
+                data + *offset, min_ao, max_light,
                 ex, ey, ez, 1, ew, rotation);
+            *offset += total * 60;
         }
         else {
-            if (offset + total * 60 > faces * 60) continue; /* HACK FIXME */
+            /* made in one piece, then each face moved to its group */
+            float cube[6 * 60];
             make_cube(
-                data + offset, ao, light,
-                f1, f2, f3, f4, f5, f6,
+                cube, ao, light,
+                flags[0], flags[1], flags[2], flags[3], flags[4], flags[5],
                 ex, ey, ez, 1, ew);
+            place_faces(data, offsets, ends, cube, flags, block_group(ew));
         }
-        offset += total * 60;
     }
 
+    compute_lods(item);
+
     free(opaque);
     free(light);
     free(highest);
 
     item->faces = faces;
-    item->data = data;
+    memcpy(item->groups[0], groups, sizeof(groups));
+    item->openings = openings;
+    item->connections = connections;
+    item->data[0] = data;
+}
+
+static int regioned(int p) {
+    return (p - mod_euc(p, REGION_SIZE)) / REGION_SIZE;
+}
+
+static Region *region_slot(int p, int q, int r) {
+    int a = mod_euc(p, REGION_SLOTS);
+    int b = mod_euc(q, REGION_SLOTS);
+    int c = mod_euc(r, REGION_SLOTS);
+    return g->regions + (b * REGION_SLOTS + a) * REGION_SLOTS + c;
+}
+
+static Region *find_region(int p, int q, int r) {
+    Region *region = region_slot(p, q, r);
+    if (region->valid &&
+        region->p == p && region->q == q && region->r == r)
+    {
+        return region;
+    }
+    return 0;
+}
+
+/* notes that a chunk's region is out of date, taking over its slot from
+ * whatever region had it before */
+static void dirty_region(Chunk *chunk) {
+    int p = regioned(chunk->p);
+    int q = regioned(chunk->q);
+    int r = regioned(chunk->r);
+    Region *region = find_region(p, q, r);
+    if (!region) {
+        region = region_slot(p, q, r);
+        pool_free(&region->range);
+        region->p = p;
+        region->q = q;
+        region->r = r;
+        region->valid = 1;
+        region->built = region->changes;
+    }
+    region->changes++;
+}
+
+static int region_distance(Region *region, int p, int q, int r) {
+    int lo[3] = {region->p, region->q, region->r};
+    int at[3] = {p, q, r};
+    int result = 0;
+    for (int i = 0; i < 3; i++) {
+        int a = lo[i] * REGION_SIZE;
+        int b = a + REGION_SIZE - 1;
+        result = MAX(result, MAX(a - at[i], at[i] - b));
+    }
+    return result;
+}
+
+static void delete_regions() {
+    for (int i = 0; i < REGION_SLOTS * REGION_SLOTS * REGION_SLOTS; i++) {
+        Region *region = g->regions + i;
+        pool_free(&region->range);
+        region->valid = 0;
+    }
+}
+
+static void generate_region(WorkerItem *item) {
+    Region *region = region_slot(item->p, item->q, item->r);
+    region->pending = 0;
+    if (region != find_region(item->p, item->q, item->r) ||
+        region->changes != item->version)
+    {
+        free(item->data[0]);
+        return;
+    }
+    memcpy(region->groups, item->groups[0], sizeof(region->groups));
+    int faces = 0;
+    for (int i = 0; i < GROUPS; i++) {
+        faces += region->groups[i];
+    }
+    if (pool_alloc(&region->range, faces * 6)) {
+        pool_upload(&region->range, item->data[0]);
+        region->built = item->version;
+    }
+    else {
+        fprintf(stderr, "Chunk pool exhausted\n");
+    }
+    free(item->data[0]);
+}
+
+/* uploads the item's levels from first on; those it didn't build are
+ * left empty */
+static void upload_levels(Chunk *chunk, WorkerItem *item, int first) {
+    memcpy(chunk->groups + first, item->groups + first,
+        sizeof(chunk->groups[0]) * (LODS - first));
+    for (int i = first; i < LODS; i++) {
+        if (!g->headless) {
+            int faces = 0;
+            for (int j = 0; j < GROUPS; j++) {
+                faces += chunk->groups[i][j];
+            }
+            if (pool_alloc(chunk->ranges + i, faces * 6)) {
+                pool_upload(chunk->ranges + i, item->data[i]);
+            }
+            else {
+                fprintf(stderr, "Chunk pool exhausted\n");
+            }
+        }
+        free(item->data[i]);
+    }
+    chunk->lods = item->lods;
 }
 
 static void generate_chunk(Chunk *chunk, WorkerItem *item) {
+    if (item->coarse) {
+        upload_levels(chunk, item, 1);
+        return;
+    }
+    Stats *st = &g->stats;
+    st->meshed++;
+    profile_count(PROFILE_MESHED, 1);
+    if (chunk->received) {
+        double latency = get_clock() - chunk->received;
+        st->mesh_latency += latency;
+        st->max_mesh_latency = MAX(st->max_mesh_latency, latency);
+        st->mesh_count++;
+        chunk->received = 0;
+    }
     chunk->faces = item->faces;
-    del_buffer(chunk->buffer);
-    chunk->buffer = gen_faces(10, item->faces, item->data);
-    int diameter = g->render_radius * 2 * CHUNK_SIZE;
+    chunk->openings = item->openings;
+    chunk->connections = item->connections;
+    chunk->meshed = 1;
+    dirty_region(chunk);
+    upload_levels(chunk, item, 0);
 }
 
 static void gen_chunk_buffer(Chunk *chunk) {
     WorkerItem _item;
     WorkerItem *item = &_item;
+    State *s = &g->players->state;
     item->p = chunk->p;
     item->q = chunk->q;
     item->r = chunk->r;
+    item->lods = chunk_levels(
+        chunk, chunked(s->x), chunked(s->y), chunked(s->z));
+    item->coarse = 0;
+    item->region = 0;
     for (int dp = -1; dp <= 1; dp++) {
         for (int dq = -1; dq <= 1; dq++) {
             for (int dr = -1; dr <= 1; dr++) {
@@ -875,8 +1555,11 @@ static void gen_chunk_buffer(Chunk *chunk) {
             }
         }
     }
+    double start = get_clock();
     compute_chunk(item);
     generate_chunk(chunk, item);
+    trace_chunk("gen_chunk_buffer", start, get_clock(),
+        chunk->p, chunk->q, chunk->r);
     chunk->dirty = 0;
 }
 
@@ -884,12 +1567,24 @@ static void init_chunk(Chunk *chunk, int p, int q, int r) {
     chunk->p = p;
     chunk->q = q;
     chunk->r = r;
-    dirty_chunk(chunk);
+    chunk->edits = 0;
+    chunk->requested = 0;
+    chunk->received = 0;
+    chunk->openings = SIDES_ALL;
+    chunk->connections = CONNECTIONS_ALL;
+    chunk->meshed = 0;
+    chunk->lods = 1;
+    memset(chunk->ranges, 0, sizeof(chunk->ranges));
+    /* the chunk itself is meshed as soon as it's made; only the meshes
+     * around it need to see it */
+    chunk->dirty = 1;
+    queue_edits(chunk, EDIT_ALL | EDIT_LIGHTS);
     Map *light_map = &chunk->lights;
     int dx = p * CHUNK_SIZE - 1;
     int dy = q * CHUNK_SIZE - 1;
     int dz = r * CHUNK_SIZE - 1;
     memset(chunk->ws, 0, sizeof(chunk->ws));
+    chunk->version = cache_load(p, q, r, chunk->ws);
     map_alloc(light_map, dx, dy, dz, 0xf);
 }
 
@@ -905,8 +1600,11 @@ static void delete_chunks() {
         if (chunk_distance(chunk, p, q, r) < g->delete_radius) {
             continue;
         }
+        dirty_region(chunk);
         map_free(&chunk->lights);
-        del_buffer(chunk->buffer);
+        for (int j = 0; j < LODS; j++) {
+            pool_free(chunk->ranges + j);
+        }
         chunk->q = -1;
         int index = i;
         while (g->chunks[index].q >= 0) {
@@ -916,6 +1614,9 @@ static void delete_chunks() {
                 memcpy(chunk, c, sizeof(Chunk));
                 chunk = c;
                 chunk->q = -1;
+                /* the meshes went with the copy */
+                memset(chunk->ranges, 0, sizeof(chunk->ranges));
+                chunk->meshed = 0;
             }
             index = (index + 1) % MAX_CHUNKS;
         }
@@ -929,10 +1630,13 @@ static void delete_all_chunks() {
         Chunk *chunk = g->chunks + i;
         if (chunk->q < 0) continue;
         map_free(&chunk->lights);
-        del_buffer(chunk->buffer);
+        for (int j = 0; j < LODS; j++) {
+            pool_free(chunk->ranges + j);
+        }
         chunk->q = -1;
     }
     g->chunk_count = 0;
+    delete_regions();
 }
 
 static void check_workers() {
@@ -941,12 +1645,20 @@ static void check_workers() {
         mtx_lock(&worker->mtx);
         if (worker->state == WORKER_DONE) {
             WorkerItem *item = &worker->item;
-            Chunk *chunk = find_chunk(item->p, item->q, item->r);
-            if (chunk) {
+            Chunk *chunk = item->region ? 0 :
+                find_chunk(item->p, item->q, item->r);
+            if (item->region) {
+                generate_region(item);
+            }
+            else if (chunk) {
+                double start = get_clock();
                 if (item->load) {
-                    client_chunk(item->p, item->q, item->r);
+                    client_chunk(item->p, item->q, item->r, chunk->version);
+                    chunk->requested = start;
                 }
                 generate_chunk(chunk, item);
+                trace_chunk("generate_chunk", start, get_clock(),
+                    item->p, item->q, item->r);
             }
             worker->state = WORKER_IDLE;
         }
@@ -980,7 +1692,8 @@ static void force_chunks(Player *player) {
                     chunk = g->chunks + index;
                     g->chunk_count++;
                     init_chunk(chunk, a, b, c);
-                    client_chunk(a, b, c);
+                    client_chunk(a, b, c, chunk->version);
+                    chunk->requested = get_clock();
                     gen_chunk_buffer(chunk);
                 }
             }
@@ -988,14 +1701,11 @@ static void force_chunks(Player *player) {
     }
 }
 
-static void ensure_chunks_worker(Player *player, Worker *worker) {
+/* inside is cull_chunks' grid, out to the create radius */
+static void ensure_chunks_worker(
+    Player *player, Worker *worker, const char *inside)
+{
     State *s = &player->state;
-    float matrix[16];
-    set_matrix_3d(
-        matrix, g->width, g->height,
-        s->x, s->y, s->z, s->rx, s->ry, g->fov, 0, g->render_radius);
-    float planes[6][4];
-    frustum_planes(planes, g->render_radius, matrix);
     int p = chunked(s->x);
     int q = chunked(s->y);
     int r = chunked(s->z);
@@ -1017,15 +1727,21 @@ static void ensure_chunks_worker(Player *player, Worker *worker) {
                 if (index != worker->index) {
                     continue;
                 }
+                /* meshed chunks come back for the coarse levels once
+                 * they're far enough to need them */
                 Chunk *chunk = find_chunk(a, b, c);
-                if (chunk && !chunk->dirty) {
+                if (chunk && !chunk->dirty && (!chunk->meshed ||
+                    chunk->lods >= chunk_levels(chunk, p, q, r)))
+                {
                     continue;
                 }
                 int distance = MAX(ABS(dp), ABS(dq));
-                int invisible = !chunk_visible(planes, a, b, c);
+                int size = rad * 2 + 1;
+                int invisible = !inside[
+                    ((dq + rad) * size + dp + rad) * size + dr + rad];
                 int priority = 0;
                 if (chunk) {
-                    priority = chunk->buffer && chunk->dirty ? 1 : 0;
+                    priority = chunk->meshed ? 1 : 0;
                 }
                 int score = (invisible << 24) | (priority << 16) | distance;
                 if (score < best_score) {
@@ -1063,6 +1779,9 @@ static void ensure_chunks_worker(Player *player, Worker *worker) {
     item->q = chunk->q;
     item->r = chunk->r;
     item->load = load;
+    item->lods = chunk_levels(chunk, p, q, r);
+    item->coarse = !load && !chunk->dirty;
+    item->region = 0;
     for (int dp = -1; dp <= 1; dp++) {
         for (int dq = -1; dq <= 1; dq++) {
             for (int dr = -1; dr <= 1; dr++) {
@@ -1082,34 +1801,129 @@ static void ensure_chunks_worker(Player *player, Worker *worker) {
         }
     }
     chunk->dirty = 0;
+    item->queued = get_clock();
     worker->state = WORKER_BUSY;
     cnd_signal(&worker->cnd);
 }
 
-static void ensure_chunks(Player *player) {
-    check_workers();
-    force_chunks(player);
-    for (int i = 0; i < WORKERS; i++) {
-        Worker *worker = g->workers + i;
-        mtx_lock(&worker->mtx);
-        if (worker->state == WORKER_IDLE) {
-            ensure_chunks_worker(player, worker);
+/* hands an idle worker the nearest far region that is out of date; only
+ * done when no chunk needs it, so a region is merged once its chunks
+ * have settled rather than after each of them */
+static void ensure_regions_worker(Player *player, Worker *worker) {
+    State *s = &player->state;
+    int p = chunked(s->x);
+    int q = chunked(s->y);
+    int r = chunked(s->z);
+    Region *best = 0;
+    int best_distance = 0;
+    for (int i = 0; i < REGION_SLOTS * REGION_SLOTS * REGION_SLOTS; i++) {
+        Region *region = g->regions + i;
+        if (!region->valid || region->pending ||
+            region->built == region->changes)
+        {
+            continue;
+        }
+        int distance = region_distance(region, p, q, r);
+        if (distance < REGION_DISTANCE - 1 ||
+            distance > g->render_radius)
+        {
+            continue;
+        }
+        if (!best || distance < best_distance) {
+            best = region;
+            best_distance = distance;
         }
-        mtx_unlock(&worker->mtx);
     }
-}
+    if (!best) {
+        return;
+    }
+    WorkerItem *item = &worker->item;
+    item->p = best->p;
+    item->q = best->q;
+    item->r = best->r;
+    item->load = 0;
+    item->region = 1;
+    item->version = best->changes;
+    for (int a = 0; a < REGION_SIZE; a++) {
+        for (int b = 0; b < REGION_SIZE; b++) {
+            for (int c = 0; c < REGION_SIZE; c++) {
+                item->members[a][b][c] = find_chunk(
+                    best->p * REGION_SIZE + a, best->q * REGION_SIZE + b,
+                    best->r * REGION_SIZE + c);
+            }
+        }
+    }
+    best->pending = 1;
+    item->queued = get_clock();
+    worker->state = WORKER_BUSY;
+    cnd_signal(&worker->cnd);
+}
+
+static void ensure_chunks(Player *player) {
+    flush_dirty_chunks();
+    check_workers();
+    force_chunks(player);
+    char *inside = 0;
+    for (int i = 0; i < WORKERS; i++) {
+        Worker *worker = g->workers + i;
+        mtx_lock(&worker->mtx);
+        if (worker->state == WORKER_IDLE && !inside) {
+            State *s = &player->state;
+            float matrix[16];
+            set_matrix_3d(
+                matrix, g->width, g->height,
+                s->x, s->y, s->z, s->rx, s->ry, g->fov, 0, g->render_radius);
+            float planes[6][4];
+            frustum_planes(planes, g->render_radius, matrix);
+            int size = g->create_radius * 2 + 1;
+            inside = malloc(size * size * size);
+            cull_chunks(
+                planes, chunked(s->x), chunked(s->y), chunked(s->z),
+                g->create_radius, inside);
+        }
+        if (worker->state == WORKER_IDLE) {
+            ensure_chunks_worker(player, worker, inside);
+        }
+        if (worker->state == WORKER_IDLE && !g->headless) {
+            ensure_regions_worker(player, worker);
+        }
+        mtx_unlock(&worker->mtx);
+    }
+    free(inside);
+}
 
 static int worker_run(void *arg) {
     Worker *worker = (Worker *)arg;
+    char name[32];
+    snprintf(name, sizeof(name), "worker %d", worker->index);
+    trace_thread(name);
     int running = 1;
     while (running) {
+        double idle = get_clock();
         mtx_lock(&worker->mtx);
         while (worker->state != WORKER_BUSY) {
             cnd_wait(&worker->cnd, &worker->mtx);
         }
         mtx_unlock(&worker->mtx);
         WorkerItem *item = &worker->item;
-        compute_chunk(item);
+        double start = get_clock();
+        trace_event("idle", idle, MAX(idle, item->queued));
+        trace_event("queued", MAX(idle, item->queued), start);
+        if (item->region) {
+            compute_region(item);
+            trace_chunk("compute_region", start, get_clock(),
+                item->p, item->q, item->r);
+        }
+        else if (item->coarse) {
+            compute_lods(item);
+            trace_chunk("compute_lods", start, get_clock(),
+                item->p, item->q, item->r);
+        }
+        else {
+            compute_chunk(item);
+            trace_chunk("compute_chunk", start, get_clock(),
+                item->p, item->q, item->r);
+        }
         mtx_lock(&worker->mtx);
         worker->state = WORKER_DONE;
         mtx_unlock(&worker->mtx);
@@ -1127,7 +1941,7 @@ static void toggle_light(int x, int y, int z) {
         int w = map_get(map, x, y, z) ? 0 : 15;
         map_set(map, x, y, z, w);
         client_light(x, y, z, w);
-        dirty_chunk(chunk);
+        dirty_light(chunk, x, y, z);
     }
 }
 
@@ -1136,7 +1950,7 @@ static void set_light(int x, int y, int z, int w) {
     if (chunk) {
         Map *map = &chunk->lights;
         if (map_set(map, x, y, z, w)) {
-            dirty_chunk(chunk);
+            dirty_light(chunk, x, y, z);
         }
     }
 }
@@ -1145,7 +1959,7 @@ static void set_block(int x, int y, int z, int w) {
     Chunk *chunk = find_chunk(chunked(x), chunked(y), chunked(z));
     if (chunk) {
         if (chunk_set(chunk, x, y, z, w)) {
-            dirty_chunk(chunk);
+            dirty_block(chunk, x, y, z);
         }
     }
     if (w == 0) {
@@ -1164,10 +1978,356 @@ static void resize_world(int radius) {
     g->render_radius = radius;
 }
 
-static int render_world(Attrib *attrib, Player *player) {
+/* collects the chunks to draw by walking out from the camera's chunk
+ * through the sides each chunk connects: a chunk entered by one side is
+ * left only by the sides it can see from there, and the walk never turns
+ * back against a direction it has already stepped in, so what's reached
+ * is roughly what a line of sight could reach. every chunk reached is
+ * drawn. coordinates with no chunk, and chunks not meshed yet, connect
+ * every side */
+static int visible_chunks(
+    float planes[6][4], int p, int q, int r, int radius, Chunk **result)
+{
+    static const int offsets[SIDES][3] = {
+        {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}
+    };
+    int size = radius * 2 + 1;
+    /* per coordinate, the exits already taken from it and SIDES_REACHED,
+     * and the directions common to every walk that took them */
+    char *seen = calloc(size * size * size, sizeof(char));
+    char *paths = calloc(size * size * size, sizeof(char));
+    char *inside = malloc(size * size * size);
+    cull_chunks(planes, p, q, r, radius, inside);
+    int capacity = 1024;
+    int *queue = malloc(sizeof(int) * 5 * capacity);
+    int head = 0;
+    int tail = 0;
+    int count = 0;
+    /* the camera can sit right on a chunk's edge or corner, where the
+     * lines of sight skip the side neighbours a walk would have to step
+     * through, so every chunk next to the camera's starts a walk */
+    int near = MIN(radius, 1);
+    for (int dp = -near; dp <= near; dp++) {
+        for (int dq = -near; dq <= near; dq++) {
+            for (int dr = -near; dr <= near; dr++) {
+                int index = ((dq + radius) * size + dp + radius) * size +
+                    dr + radius;
+                if (q + dq < 0) {
+                    continue;
+                }
+                seen[index] = SIDES_REACHED;
+                if ((dp || dq || dr) && !inside[index]) {
+                    continue;
+                }
+                Chunk *chunk = find_chunk(p + dp, q + dq, r + dr);
+                if (chunk) {
+                    result[count++] = chunk;
+                }
+                queue[tail++] = p + dp;
+                queue[tail++] = q + dq;
+                queue[tail++] = r + dr;
+                queue[tail++] = -1;
+                queue[tail++] = 0;
+            }
+        }
+    }
+    while (head < tail) {
+        int a = queue[head++];
+        int b = queue[head++];
+        int c = queue[head++];
+        int entry = queue[head++];
+        int directions = queue[head++];
+        Chunk *chunk = find_chunk(a, b, c);
+        int exits = SIDES_ALL;
+        if (chunk && entry < 0) {
+            exits = chunk->openings;
+        }
+        else if (chunk) {
+            exits = 0;
+            for (int side = 0; side < SIDES; side++) {
+                if (side != entry &&
+                    (chunk->connections & side_pair(entry, side)))
+                {
+                    exits |= 1 << side;
+                }
+            }
+        }
+        for (int side = 0; side < SIDES; side++) {
+            if (directions & (1 << (side ^ 1))) {
+                exits &= ~(1 << side);
+            }
+        }
+        int index =
+            ((b - q + radius) * size + a - p + radius) * size + c - r + radius;
+        int taken = seen[index] & SIDES_ALL;
+        if (taken && !(paths[index] & ~directions)) {
+            /* a walk at least as free already went everywhere this can */
+            exits &= ~taken;
+        }
+        paths[index] = taken ? paths[index] & directions : directions;
+        seen[index] |= exits;
+        for (int side = 0; side < SIDES; side++) {
+            if (!(exits & (1 << side))) {
+                continue;
+            }
+            int na = a + offsets[side][0];
+            int nb = b + offsets[side][1];
+            int nc = c + offsets[side][2];
+            int da = na - p + radius;
+            int db = nb - q + radius;
+            int dc = nc - r + radius;
+            if (nb < 0 || da < 0 || db < 0 || dc < 0 ||
+                da >= size || db >= size || dc >= size)
+            {
+                continue;
+            }
+            int other = (db * size + da) * size + dc;
+            char *other_state = seen + other;
+            if (!*other_state) {
+                *other_state = SIDES_REACHED;
+                if (!inside[other]) {
+                    *other_state |= SIDES_ALL;
+                    continue;
+                }
+                Chunk *chunk = find_chunk(na, nb, nc);
+                if (chunk) {
+                    result[count++] = chunk;
+                }
+            }
+            if ((*other_state & SIDES_ALL) == SIDES_ALL) {
+                continue;
+            }
+            if (tail + 5 > capacity * 5) {
+                capacity *= 2;
+                queue = realloc(queue, sizeof(int) * 5 * capacity);
+            }
+            queue[tail++] = na;
+            queue[tail++] = nb;
+            queue[tail++] = nc;
+            queue[tail++] = side ^ 1;
+            queue[tail++] = directions | (1 << side);
+        }
+    }
+    free(seen);
+    free(paths);
+    free(inside);
+    free(queue);
+    return count;
+}
+
+/* sorts chunks nearest first for the translucent pass, which draws them
+ * in reverse so glass and water blend back to front. it isn't for the
+ * depth test: measured, it culled no more fragments than the walk's own
+ * order. that order is by steps taken, which can put a far chunk ahead
+ * of a near one seen round a corner. the sort is by buckets a quarter
+ * of a chunk wide, keyed by coordinate around p, q, r; the keys are
+ * worked out when the camera enters a chunk and kept until it leaves */
+static void order_chunks(
+    Chunk **chunks, int count, int p, int q, int r, int radius,
+    float x, float y, float z)
+{
+    int size = radius * 2 + 1;
+    if (!g->order_keys || g->order_p != p || g->order_q != q ||
+        g->order_r != r || g->order_radius != radius)
+    {
+        free(g->order_keys);
+        g->order_keys = malloc(sizeof(unsigned short) * size * size * size);
+        g->order_buckets = 0;
+        unsigned short *key = g->order_keys;
+        for (int dq = -radius; dq <= radius; dq++) {
+            for (int dp = -radius; dp <= radius; dp++) {
+                for (int dr = -radius; dr <= radius; dr++) {
+                    float half = CHUNK_SIZE / 2.0;
+                    float cx = (p + dp) * CHUNK_SIZE + half - x;
+                    float cy = (q + dq) * CHUNK_SIZE + half - y;
+                    float cz = (r + dr) * CHUNK_SIZE + half - z;
+                    float d = sqrtf(cx * cx + cy * cy + cz * cz);
+                    *key = d * 4 / CHUNK_SIZE;
+                    g->order_buckets = MAX(g->order_buckets, *key + 1);
+                    key++;
+                }
+            }
+        }
+        g->order_p = p;
+        g->order_q = q;
+        g->order_r = r;
+        g->order_radius = radius;
+    }
+    int *starts = calloc(g->order_buckets + 1, sizeof(int));
+    int *keys = malloc(sizeof(int) * count);
+    for (int i = 0; i < count; i++) {
+        Chunk *chunk = chunks[i];
+        int index = ((chunk->q - q + radius) * size + chunk->p - p + radius) *
+            size + chunk->r - r + radius;
+        keys[i] = g->order_keys[index];
+        starts[keys[i] + 1]++;
+    }
+    for (int i = 0; i < g->order_buckets; i++) {
+        starts[i + 1] += starts[i];
+    }
+    Chunk **sorted = malloc(sizeof(Chunk *) * count);
+    for (int i = 0; i < count; i++) {
+        sorted[starts[keys[i]]++] = chunks[i];
+    }
+    memcpy(chunks, sorted, sizeof(Chunk *) * count);
+    free(sorted);
+    free(keys);
+    free(starts);
+}
+
+/* the level of detail to draw a chunk at: each is used from twice the
+ * distance of the one before */
+static int chunk_lod(Chunk *chunk, int p, int q, int r) {
+    int distance = chunk_distance(chunk, p, q, r);
+    int lod = 0;
+    while (lod < LODS - 1 && distance >= LOD_DISTANCE << lod) {
+        lod++;
+    }
+    return lod;
+}
+
+/* the groups of a chunk's mesh with faces that can point towards the
+ * camera. a face on a block's +x side only faces a camera further along
+ * x than it, give or take the tilt displaced corners put on it, which
+ * grows with how far off to the side the camera is */
+static int facing_groups(
+    int p, int q, int r, float n, float x, float y, float z)
+{
+    float lo[3] = {p * n, q * n, r * n};
+    float camera[3] = {x, y, z};
+    float reach[3];
+    for (int i = 0; i < 3; i++) {
+        reach[i] = MAX(ABS(camera[i] - lo[i]), ABS(camera[i] - lo[i] - n));
+    }
+    int result = 0;
+    for (int i = 0; i < 3; i++) {
+        float slack = FACE_SLANT * (reach[(i + 1) % 3] + reach[(i + 2) % 3]);
+        if (camera[i] < lo[i] + n + slack) {
+            result |= 1 << (i * 2);
+        }
+        if (camera[i] > lo[i] - slack) {
+            result |= 1 << (i * 2 + 1);
+        }
+    }
+    return result;
+}
+
+/* queues the groups of a mesh picked by a mask, neighbouring ones that
+ * are both drawn going out as one range; returns the faces queued */
+static int draw_groups(PoolRange *range, int counts[GROUPS], int groups) {
+    int result = 0;
+    int first = 0;
+    int length = 0;
+    for (int i = 0; i < GROUPS; i++) {
+        int size = counts[i] * 6;
+        if (groups & (1 << i)) {
+            length += size;
+            result += counts[i];
+            continue;
+        }
+        pool_draw_add(range, first, length);
+        first += length + size;
+        length = 0;
+    }
+    pool_draw_add(range, first, length);
+    return result;
+}
+
+static void use_block_program(Attrib *attrib, float *matrix, State *s) {
+    glstate_use_program(attrib->program);
+
+    glstate_uniform_matrix4(attrib->matrix, matrix);
+    glstate_uniform3f(attrib->camera, s->x, s->y + 1.7, s->z);
+
+    glstate_uniform1i(attrib->sampler, 0);
+
+    glstate_uniform1f(attrib->timer, time_of_day());
+    glstate_uniform1i(attrib->extra1, g->render_radius * CHUNK_SIZE);
+}
+
+/* the shared player cube, and a vertex array that takes a set of
+ * from, to and angles from the instance buffer for each copy */
+static void gen_player_arrays(Attrib *attrib) {
+    GLfloat *data = malloc_faces(10, 6);
+    make_player(data, 0, 0, 0, 0, 0);
+    g->player_buffer = gen_faces(10, 6, data);
+    glGenBuffers(1, &g->player_instances);
+    glGenVertexArrays(1, &g->player_vao);
+    glstate_bind_vertex_array(g->player_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, g->player_buffer);
+    glEnableVertexAttribArray(attrib->position);
+    glEnableVertexAttribArray(attrib->normal);
+    glEnableVertexAttribArray(attrib->uv);
+    glVertexAttribPointer(attrib->position, 3, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, 0);
+    glVertexAttribPointer(attrib->normal, 3, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 3));
+    glVertexAttribPointer(attrib->uv, 4, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 6));
+    GLuint instance[3] = {attrib->from, attrib->to, attrib->angles};
+    glBindBuffer(GL_ARRAY_BUFFER, g->player_instances);
+    for (int i = 0; i < 3; i++) {
+        glEnableVertexAttribArray(instance[i]);
+        glVertexAttribPointer(instance[i], 4, GL_FLOAT, GL_FALSE,
+            sizeof(GLfloat) * 12, (GLvoid *)(sizeof(GLfloat) * 4 * i));
+        glVertexAttribDivisor(instance[i], 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/* draws every other player in one call, as copies of a single cube. each
+ * copy gets the player's last two updates, which only have to be sent
+ * again when one comes in; the shader moves players between them */
+static void render_players(Attrib *attrib, float *matrix, Player *player) {
+    if (!GLEW_VERSION_3_3) {
+        return;
+    }
+    if (!g->player_vao) {
+        gen_player_arrays(attrib);
+    }
+    if (g->players_changed) {
+        GLfloat *data = malloc(sizeof(GLfloat) * 12 * MAX_PLAYERS);
+        GLfloat *d = data;
+        for (int i = 0; i < g->player_count; i++) {
+            Player *other = g->players + i;
+            if (other == player) {
+                continue;
+            }
+            State *s1 = &other->state1;
+            State *s2 = &other->state2;
+            *(d++) = s1->x; *(d++) = s1->y; *(d++) = s1->z; *(d++) = s1->t;
+            *(d++) = s2->x; *(d++) = s2->y; *(d++) = s2->z; *(d++) = s2->t;
+            *(d++) = s1->rx; *(d++) = s1->ry; *(d++) = s2->rx; *(d++) = s2->ry;
+        }
+        g->player_instance_count = (d - data) / 12;
+        glBindBuffer(GL_ARRAY_BUFFER, g->player_instances);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * (d - data), data,
+            GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        free(data);
+        g->players_changed = 0;
+    }
+    if (!g->player_instance_count) {
+        return;
+    }
+    use_block_program(attrib, matrix, &player->state);
+    glstate_uniform1f(attrib->extra2, get_time());
+    glstate_bind_vertex_array(g->player_vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, g->player_instance_count);
+    profile_count(PROFILE_DRAWS, 1);
+}
+
+/* draws the opaque faces, then the cutouts with a program that drops
+ * their empty texels, so the opaque pass keeps its early depth test, then
+ * the other players, then the translucent faces in the reverse of the
+ * chunk order, blended over the rest without writing depth. coarse
+ * meshes are all opaque */
+static int render_world(
+    Attrib *attrib, Attrib *cutout_attrib, Attrib *player_attrib,
+    Player *player)
+{
     int face_count = 0;
     State *s = &player->state;
-    ensure_chunks(player);
     int p = chunked(s->x), q = chunked(s->y), r = chunked(s->z);
 
     float matrix[16];
@@ -1177,77 +2337,199 @@ static int render_world(Attrib *attrib, Player *player) {
     float planes[6][4];
     frustum_planes(planes, g->render_radius, matrix);
 
-    glUseProgram(attrib->program);
-
-    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
-    glUniform3f(attrib->camera, s->x, s->y + 1.7, s->z);
-
-    glUniform1i(attrib->sampler, 0);
-
-    glUniform1f(attrib->timer, time_of_day());
-    glUniform1i(attrib->extra1, g->render_radius * CHUNK_SIZE);
-
-    glEnableVertexAttribArray(attrib->position);
-    glEnableVertexAttribArray(attrib->normal);
-    glEnableVertexAttribArray(attrib->uv);
-
-    for (int i = 0; i < MAX_CHUNKS; i++) {
-        Chunk *chunk = g->chunks + i;
-        if (chunk->q < 0) continue;
-        if (chunk_distance(chunk, p, q, r) > g->render_radius)
-            continue;
-        if (!chunk_visible(planes, chunk->p, chunk->q, chunk->r))
+    use_block_program(attrib, matrix, s);
+
+    Chunk **visible = malloc(sizeof(Chunk *) * MAX_CHUNKS);
+    int count = visible_chunks(
+        planes, p, q, r, g->render_radius, visible);
+    order_chunks(
+        visible, count, p, q, r, g->render_radius, s->x, s->y + 1.7, s->z);
+    g->region_frame++;
+    int *lods = malloc(sizeof(int) * count);
+    pool_draw_begin();
+    for (int i = 0; i < count; i++) {
+        Chunk *chunk = visible[i];
+        lods[i] = -1;
+        Region *region = find_region(
+            regioned(chunk->p), regioned(chunk->q), regioned(chunk->r));
+        if (region && region->built == region->changes &&
+            region_distance(region, p, q, r) >= REGION_DISTANCE)
+        {
+            /* the first of its chunks seen draws the whole region */
+            if (region->drawn != g->region_frame) {
+                region->drawn = g->region_frame;
+                face_count += draw_groups(
+                    &region->range, region->groups,
+                    facing_groups(
+                        region->p, region->q, region->r,
+                        CHUNK_SIZE * REGION_SIZE, s->x, s->y + 1.7, s->z));
+            }
             continue;
+        }
+        /* coarse levels not built yet fall back to the finest */
+        int lod = lods[i] = MIN(chunk_lod(chunk, p, q, r), chunk->lods - 1);
+        face_count += draw_groups(
+            chunk->ranges + lod, chunk->groups[lod],
+            facing_groups(
+                chunk->p, chunk->q, chunk->r, CHUNK_SIZE,
+                s->x, s->y + 1.7, s->z));
+    }
+    pool_draw_end();
 
-        glBindBuffer(GL_ARRAY_BUFFER, chunk->buffer);
+    use_block_program(cutout_attrib, matrix, s);
+    pool_draw_begin();
+    for (int i = 0; i < count; i++) {
+        if (lods[i] == 0) {
+            face_count += draw_groups(
+                visible[i]->ranges, visible[i]->groups[0], 1 << GROUP_CUTOUT);
+        }
+    }
+    pool_draw_end();
 
-        glVertexAttribPointer(attrib->position, 3, GL_FLOAT, GL_FALSE,
-            sizeof(GLfloat) * 10, 0);
-        glVertexAttribPointer(attrib->normal, 3, GL_FLOAT, GL_FALSE,
-            sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 3));
-        glVertexAttribPointer(attrib->uv, 4, GL_FLOAT, GL_FALSE,
-            sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 6));
+    render_players(player_attrib, matrix, player);
 
-        glDrawArrays(GL_TRIANGLES, 0, chunk->faces * 6);
+    use_block_program(attrib, matrix, s);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    pool_draw_begin();
+    for (int i = count - 1; i >= 0; i--) {
+        if (lods[i] == 0) {
+            face_count += draw_groups(
+                visible[i]->ranges, visible[i]->groups[0],
+                1 << GROUP_TRANSLUCENT);
+        }
+    }
+    pool_draw_end();
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    free(lods);
+    free(visible);
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return face_count;
+}
 
-        face_count += chunk->faces;
+/* makes room for more vertices of components floats at the end of a
+ * hud array and returns where they go */
+static GLfloat *hud_reserve(
+    GLfloat **data, int *count, int *capacity, int components, int more)
+{
+    if (*count + more > *capacity) {
+        while (*count + more > *capacity) {
+            *capacity = *capacity ? *capacity * 2 : 1024;
+        }
+        *data = realloc(*data, sizeof(GLfloat) * components * *capacity);
     }
+    GLfloat *result = *data + components * *count;
+    *count += more;
+    return result;
+}
 
-    glDisableVertexAttribArray(attrib->uv);
-    glDisableVertexAttribArray(attrib->normal);
-    glDisableVertexAttribArray(attrib->position);
+static void add_crosshairs() {
+    int x = g->width / 2;
+    int y = g->height / 2;
+    int p = 10 * g->scale;
+    float data[] = {
+        x, y - p, x, y + p,
+        x - p, y, x + p, y
+    };
+    GLfloat *d = hud_reserve(
+        &g->hud_lines, &g->hud_line_count, &g->hud_line_capacity, 2, 4);
+    memcpy(d, data, sizeof(data));
+}
 
-    return face_count;
+static void add_text(int justify, float x, float y, float n, char *text) {
+    int length = strlen(text);
+    x -= n * justify * (length - 1) / 2;
+    GLfloat *d = hud_reserve(
+        &g->hud_text, &g->hud_text_count, &g->hud_text_capacity,
+        4, length * 6);
+    for (int i = 0; i < length; i++) {
+        make_character(d + i * 24, x, y, n / 2, n, text[i]);
+        x += n;
+    }
 }
 
-static void render_crosshairs(Attrib *attrib) {
-    float matrix[16];
-    set_matrix_2d(matrix, g->width, g->height);
-    glUseProgram(attrib->program);
-    glLineWidth(4 * g->scale);
-    glEnable(GL_COLOR_LOGIC_OP);
-    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
-    GLuint crosshair_buffer = gen_crosshair_buffer();
-    draw_lines(attrib, crosshair_buffer, 2, 4);
-    del_buffer(crosshair_buffer);
-    glDisable(GL_COLOR_LOGIC_OP);
-}
-
-static void render_text(
-    Attrib *attrib, int justify, float x, float y, float n, char *text)
-{
+/* draws the frame's hud lines, then its text over them, both from one
+ * buffer filled with a single upload, and empties the hud. text vertices
+ * are twice the size of line vertices, so with the text first the lines
+ * start on a whole vertex and both arrays can point at offset zero */
+static void render_hud(Attrib *line_attrib, Attrib *text_attrib) {
+    size_t text = sizeof(GLfloat) * 4 * g->hud_text_count;
+    size_t lines = sizeof(GLfloat) * 2 * g->hud_line_count;
+    if (!g->hud_buffer) {
+        glGenBuffers(1, &g->hud_buffer);
+        g->hud_line_vao = gen_vao_2d(line_attrib, g->hud_buffer, 0);
+        g->hud_text_vao = gen_vao_2d(text_attrib, g->hud_buffer, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, g->hud_buffer);
+    /* orphans last frame's storage rather than wait for it to be drawn */
+    glBufferData(GL_ARRAY_BUFFER, text + lines, 0, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, text, g->hud_text);
+    glBufferSubData(GL_ARRAY_BUFFER, text, lines, g->hud_lines);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     float matrix[16];
     set_matrix_2d(matrix, g->width, g->height);
-    glUseProgram(attrib->program);
-    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
-    glUniform1i(attrib->sampler, 1);
-    int length = strlen(text);
-    x -= n * justify * (length - 1) / 2;
-    GLuint buffer = gen_text_buffer(x, y, n, text);
-    draw_text(attrib, buffer, length);
-    del_buffer(buffer);
+    profile_gpu_begin(PROFILE_CROSSHAIR);
+    if (g->hud_line_count) {
+        glstate_use_program(line_attrib->program);
+        glstate_uniform_matrix4(line_attrib->matrix, matrix);
+        glLineWidth(4 * g->scale);
+        glEnable(GL_COLOR_LOGIC_OP);
+        draw_arrays(g->hud_line_vao, GL_LINES,
+            g->hud_text_count * 2, g->hud_line_count);
+        glDisable(GL_COLOR_LOGIC_OP);
+    }
+    profile_gpu_end(PROFILE_CROSSHAIR);
+    profile_gpu_begin(PROFILE_TEXT);
+    if (g->hud_text_count) {
+        glstate_use_program(text_attrib->program);
+        glstate_uniform_matrix4(text_attrib->matrix, matrix);
+        glstate_uniform1i(text_attrib->sampler, 1);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        draw_arrays(g->hud_text_vao, GL_TRIANGLES, 0, g->hud_text_count);
+        glDisable(GL_BLEND);
+    }
+    profile_gpu_end(PROFILE_TEXT);
+    g->hud_line_count = 0;
+    g->hud_text_count = 0;
+}
+
+static void add_profile(float x, float y, float n) {
+    char text[64];
+    for (int i = 0; i < PROFILE_PHASES; i++) {
+        double p50, p99;
+        profile_phase(i, &p50, &p99);
+        snprintf(text, sizeof(text), "%-8s %6.2f %6.2f ms",
+            profile_phase_name(i), p50, p99);
+        add_text(ALIGN_LEFT, x, y, n, text);
+        y -= n * 2;
+    }
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        double p50, p99;
+        profile_counter(i, &p50, &p99);
+        snprintf(text, sizeof(text), "%-8s %6.0f %6.0f",
+            profile_counter_name(i), p50, p99);
+        add_text(ALIGN_LEFT, x, y, n, text);
+        y -= n * 2;
+    }
+    for (int i = 0; i < PROFILE_PASSES; i++) {
+        double p50, p99;
+        if (!profile_gpu(i, &p50, &p99)) {
+            break;
+        }
+        snprintf(text, sizeof(text), "gpu %-9s %6.2f %6.2f ms",
+            profile_pass_name(i), p50, p99);
+        add_text(ALIGN_LEFT, x, y, n, text);
+        y -= n * 2;
+    }
+    PoolStats pool;
+    pool_stats(&pool);
+    snprintf(text, sizeof(text), "pool %.0f/%.0f MB %d meshes %.0f%% holes",
+        pool.used / 1048576.0, pool.capacity / 1048576.0, pool.allocations,
+        pool.span ? pool.holes * 100.0 / pool.span : 0);
+    add_text(ALIGN_LEFT, x, y, n, text);
 }
 
 static void add_message(const char *text) {
@@ -1277,6 +2559,26 @@ static void parse_command(const char *buffer, int forward) {
             add_message("Viewing distance must be between 1 and 24.");
         }
     }
+    else if (sscanf(buffer, "/profile %255s", filename) == 1) {
+        if (profile_csv_open(filename)) {
+            add_message("Writing frame profile.");
+        }
+        else {
+            add_message("Could not open profile file.");
+        }
+    }
+    else if (strcmp(buffer, "/profile") == 0) {
+        profile_csv_close();
+        add_message("Stopped frame profile.");
+    }
+    else if (sscanf(buffer, "/trace %255s", filename) == 1) {
+        if (trace_write(filename)) {
+            add_message("Wrote trace.");
+        }
+        else {
+            add_message("Could not write trace.");
+        }
+    }
     else if (forward) {
         client_talk(buffer);
     }
@@ -1395,6 +2697,9 @@ static void on_key(GLFWwindow *window, int key, int scancode, int action, int mo
         if (key == CRAFT_KEY_FLY) {
             g->flying = !g->flying;
         }
+        if (key == CRAFT_KEY_PROFILE) {
+            g->show_profile = !g->show_profile;
+        }
         if (key >= '1' && key <= '9') {
             g->item_index = key - '1';
         }
@@ -1547,7 +2852,16 @@ static void handle_movement(double dt) {
     State *s = &g->players->state;
     int sz = 0;
     int sx = 0;
-    if (!g->typing) {
+    /* a headless replay stands still, as the recording client did */
+    int simulate = g->headless && !g->replaying;
+    if (simulate) {
+        /* fly forward on a slowly turning heading, streaming in new
+         * chunks and coming back around to old ones every two minutes */
+        sz = -1;
+        s->rx += dt * 0.05;
+        s->ry = 0;
+    }
+    else if (!g->typing && !g->headless) {
         float m = dt * 1.0;
         g->fov = glfwGetKey(g->window, CRAFT_KEY_ZOOM) ? 15 : 80;
         if (glfwGetKey(g->window, CRAFT_KEY_FORWARD)) sz--;
@@ -1561,7 +2875,17 @@ static void handle_movement(double dt) {
     }
     float vx, vy, vz;
     get_motion_vector(g->flying, sz, sx, s->rx, s->ry, &vx, &vy, &vz);
-    if (!g->typing) {
+    if (simulate) {
+        /* keep a few blocks above the terrain */
+        int h = highest_block(s->x, s->z);
+        if (s->y < h + 4) {
+            vy = 1;
+        }
+        else if (h && s->y > h + 8) {
+            vy = -1;
+        }
+    }
+    else if (!g->typing && !g->headless) {
         if (glfwGetKey(g->window, CRAFT_KEY_JUMP)) {
             if (g->flying) {
                 vy = 1;
@@ -1601,6 +2925,45 @@ static void handle_movement(double dt) {
     }
 }
 
+#define B16R(x) (((unsigned char)(x)[0] << 8) | ((unsigned char)(x)[1] << 0))
+#define B32R(x) (((unsigned int)(unsigned char)(x)[0] << 24) | ((unsigned int)(unsigned char)(x)[1] << 16) | ((unsigned int)(unsigned char)(x)[2] << 8) | ((unsigned int)(unsigned char)(x)[3] << 0))
+#define B64R(x) (((int64_t)(unsigned char)(x)[0] << 56) | ((int64_t)(unsigned char)(x)[1] << 48) | ((int64_t)(unsigned char)(x)[2] << 40) | ((int64_t)(unsigned char)(x)[3] << 32) | ((int64_t)(unsigned char)(x)[4] << 24) | ((int64_t)(unsigned char)(x)[5] << 16) | ((int64_t)(unsigned char)(x)[6] << 8) | ((int64_t)(unsigned char)(x)[7] << 0))
+
+/* a delta is a list of runs, each [16-bit offset][16-bit length][8-bit w],
+ * offsets indexing chunk->ws; returns whether anything changed */
+static int apply_chunk_delta(Chunk *chunk, const char *data, size_t size) {
+    const int volume = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+    int changed = 0;
+    int faces = 0;
+    for (; size >= 5; data += 5, size -= 5) {
+        int index = B16R(data);
+        int length = B16R(data + 2);
+        int w = (unsigned char)data[4];
+        if (index >= volume) {
+            continue;
+        }
+        length = MIN(length, volume - index);
+        for (int i = index; i < index + length; i++) {
+            if (chunk->ws[i] == w) {
+                continue;
+            }
+            chunk->ws[i] = w;
+            changed = 1;
+            int x = chunk->p * CHUNK_SIZE + i % CHUNK_SIZE;
+            int y = chunk->q * CHUNK_SIZE + i / CHUNK_SIZE % CHUNK_SIZE;
+            int z = chunk->r * CHUNK_SIZE + i / (CHUNK_SIZE * CHUNK_SIZE);
+            faces |= block_faces(x, y, z);
+            if (w == 0 && chunk->lights.size) {
+                map_set(&chunk->lights, x, y, z, 0);
+            }
+        }
+    }
+    if (changed) {
+        dirty_faces(chunk, faces);
+    }
+    return changed;
+}
+
 static void parse_buffer(char *buf, size_t tsize) {
     Player *me = g->players;
     State *s = &g->players->state;
@@ -1610,17 +2973,16 @@ static void parse_buffer(char *buf, size_t tsize) {
     float px, py, pz, prx, pry;
     double elapsed;
     int day_length;
+    char codec[16];
     while (tsize) {
         size_t bsize = *(size_t *)buf;
         char *buffer = buf + sizeof(size_t);
         tsize -= bsize + sizeof(size_t);
         buf += bsize + sizeof(size_t);
         if (buffer[0] == 'C') {
-#define B64R(x) (((int64_t)(x)[0] << 56) | ((int64_t)(x)[1] << 48) | ((int64_t)(x)[2] << 40) | ((int64_t)(x)[3] << 32) | ((int64_t)(x)[4] << 24) | ((int64_t)(x)[5] << 16) | ((int64_t)(x)[6] << 8) | ((int64_t)(x)[7] << 0))
             int64_t p = B64R(buffer+1);
             int64_t q = B64R(buffer+9);
             int64_t r = B64R(buffer+17);
-#undef B64R
             buffer += 25;
             bsize -= 26;
             Chunk *chunk = find_chunk(p, q, r);
@@ -1634,8 +2996,19 @@ static void parse_buffer(char *buf, size_t tsize) {
                 }
             }
             if (chunk) {
-                size_t len = tinfl_decompress_mem_to_mem(chunk->ws, sizeof(chunk->ws), buffer, bsize, 0);
+                codec_decompress(g->codec, chunk->ws, sizeof(chunk->ws),
+                    (unsigned char *)buffer, bsize);
                 dirty_chunk(chunk);
+                g->stats.received++;
+                chunk->received = get_clock();
+                if (chunk->requested) {
+                    double latency = chunk->received - chunk->requested;
+                    g->stats.network_latency += latency;
+                    g->stats.max_network_latency = MAX(
+                        g->stats.max_network_latency, latency);
+                    g->stats.network_count++;
+                    chunk->requested = 0;
+                }
                 if (chunked(s->x) == p && chunked(s->z) == r) {
                     if (player_intersects_block(2, s->x, s->y, s->z, s->x, s->y, s->z)) {
                         s->y = highest_block(s->x, s->z);
@@ -1644,6 +3017,30 @@ static void parse_buffer(char *buf, size_t tsize) {
             } else {
                 printf("Chunk discarded\n");
             }
+        } else if (buffer[0] == 'S' && bsize >= 30) {
+            int64_t p = B64R(buffer+1);
+            int64_t q = B64R(buffer+9);
+            int64_t r = B64R(buffer+17);
+            unsigned int version = B32R(buffer+25);
+            Chunk *chunk = find_chunk(p, q, r);
+            if (chunk) {
+                chunk->version = version;
+                chunk->requested = 0;
+                cache_store(p, q, r, version, chunk->ws);
+            }
+        } else if (buffer[0] == 'R' && bsize >= 26) {
+            int64_t p = B64R(buffer+1);
+            int64_t q = B64R(buffer+9);
+            int64_t r = B64R(buffer+17);
+            Chunk *chunk = find_chunk(p, q, r);
+            if (chunk && apply_chunk_delta(chunk, buffer + 25, bsize - 26)) {
+                int nx = floorf(s->x), ny = floorf(s->y), nz = floorf(s->z);
+                if (is_obstacle(get_block(nx, ny, nz)) ||
+                    is_obstacle(get_block(nx, ny + 1, nz)))
+                {
+                    s->y = highest_block(s->x, s->z) + 2;
+                }
+            }
         } else if (sscanf(buffer, "U,%d,%f,%f,%f,%f,%f",
             &pid, &ux, &uy, &uz, &urx, &ury) == 6)
         {
@@ -1654,24 +3051,16 @@ static void parse_buffer(char *buf, size_t tsize) {
                 s->y = highest_block(s->x, s->z);
             }
         } else if (sscanf(buffer, "B,%d,%d,%d,%d",
-            &bx, &by, &bz, &bw) == 6)
+            &bx, &by, &bz, &bw) == 4)
         {
             set_block(bx, by, bz, bw);
             if (player_intersects_block(2, s->x, s->y, s->z, bx, by, bz)) {
                 s->y = highest_block(s->x, s->z) + 2;
             }
-            Chunk *chunk = find_chunk(chunked(bx), chunked(by), chunked(bz));
-            if (chunk) {
-                dirty_chunk(chunk);
-            }
         } else if (sscanf(buffer, "L,%d,%d,%d,%d",
-            &bx, &by, &bz, &bw) == 6)
+            &bx, &by, &bz, &bw) == 4)
         {
             set_light(bx, by, bz, bw);
-            Chunk *chunk = find_chunk(chunked(bx), chunked(by), chunked(bz));
-            if (chunk) {
-                dirty_chunk(chunk);
-            }
         } else if (sscanf(buffer, "P,%d,%f,%f,%f,%f,%f",
             &pid, &px, &py, &pz, &prx, &pry) == 6)
         {
@@ -1680,7 +3069,6 @@ static void parse_buffer(char *buf, size_t tsize) {
                 player = g->players + g->player_count;
                 g->player_count++;
                 player->id = pid;
-                player->buffer = 0;
                 snprintf(player->name, MAX_NAME_LENGTH, "player%d", pid);
                 update_player(player, px, py, pz, prx, pry, 1); // twice
             }
@@ -1690,9 +3078,13 @@ static void parse_buffer(char *buf, size_t tsize) {
         } else if (sscanf(buffer, "D,%d", &pid) == 1) {
             delete_player(pid);
         } else if (sscanf(buffer, "E,%lf,%d", &elapsed, &day_length) == 2) {
-            glfwSetTime(fmod(elapsed, day_length));
+            set_time(fmod(elapsed, day_length));
             g->day_length = day_length;
             g->time_changed = 1;
+        } else if (sscanf(buffer, "Z,%15s", codec) == 1) {
+            if (codec_find(codec) >= 0) {
+                g->codec = codec_find(codec);
+            }
         } else if (buffer[0] == 'T' && buffer[1] == ',') {
             char *text = buffer + 2;
             add_message(text);
@@ -1710,12 +3102,74 @@ static void parse_buffer(char *buf, size_t tsize) {
     }
 }
 
+/* chunks waiting to be meshed, or being meshed; dirty chunks outside the
+ * create radius wait until the player comes back, so they don't count */
+static int meshing_backlog() {
+    State *s = &g->players->state;
+    int p = chunked(s->x);
+    int q = chunked(s->y);
+    int r = chunked(s->z);
+    int result = 0;
+    for (int i = 0; i < MAX_CHUNKS; i++) {
+        Chunk *chunk = g->chunks + i;
+        if (chunk->q >= 0 && (chunk->dirty || chunk->edits) &&
+            chunk_distance(chunk, p, q, r) <= g->create_radius)
+        {
+            result++;
+        }
+    }
+    for (int i = 0; i < WORKERS; i++) {
+        if (g->workers[i].state != WORKER_IDLE) {
+            result++;
+        }
+    }
+    return result;
+}
+
+static void report_stats(double now, int backlog, int final) {
+    Stats *st = &g->stats;
+    const char *mode = g->replaying ? "replay" : "headless";
+    if (final) {
+        double elapsed = now - st->start;
+        printf("%s: %d chunks received, %d meshed in %.2fs "
+            "(%.0f chunks/s), parse %.3fs, max backlog %d, rss %.1fMB\n",
+            mode, st->received, st->meshed, elapsed,
+            st->received / MAX(elapsed, 1e-6), st->parse_time,
+            st->max_backlog, get_rss() / 1e6);
+        return;
+    }
+    double elapsed = now - st->since;
+    printf("%s: %.1fs %.0f chunks/s received, %.0f/s meshed, "
+        "parse %.2fms, backlog %d, network %.0f/%.0fms, "
+        "mesh %.0f/%.0fms, frame %.0fms, rss %.1fMB\n",
+        mode, now - st->start,
+        (st->received - st->since_received) / elapsed,
+        (st->meshed - st->since_meshed) / elapsed,
+        (st->parse_time - st->since_parse_time) * 1000, backlog,
+        st->network_latency * 1000 / MAX(st->network_count, 1),
+        st->max_network_latency * 1000,
+        st->mesh_latency * 1000 / MAX(st->mesh_count, 1),
+        st->max_mesh_latency * 1000, st->max_frame * 1000,
+        get_rss() / 1e6);
+    fflush(stdout);
+    st->network_latency = st->max_network_latency = 0;
+    st->network_count = 0;
+    st->mesh_latency = st->max_mesh_latency = 0;
+    st->mesh_count = 0;
+    st->max_frame = 0;
+    st->since = now;
+    st->since_parse_time = st->parse_time;
+    st->since_received = st->received;
+    st->since_meshed = st->meshed;
+}
+
 static void reset_model() {
     for (int i = 0; i < MAX_CHUNKS; i++) {
         memset(g->chunks + i, 0, sizeof(Chunk));
         g->chunks[i].q = -1;
     }
     g->chunk_count = 0;
+    g->dirty_count = 0;
     memset(g->players, 0, sizeof(Player) * MAX_PLAYERS);
     g->player_count = 0;
     g->flying = 0;
@@ -1725,27 +3179,28 @@ static void reset_model() {
     memset(g->messages, 0, sizeof(char) * MAX_MESSAGES * MAX_TEXT_LENGTH);
     g->message_index = 0;
     g->day_length = DAY_LENGTH;
-    glfwSetTime(g->day_length / 3.0);
+    set_time(g->day_length / 3.0);
     g->time_changed = 1;
+    g->codec = CODEC_ZLIB;
+    memset(&g->stats, 0, sizeof(Stats));
+    g->stats.start = g->stats.since = get_clock();
 }
 
 void GLAPIENTRY ogl_debug_callback(GLenum src, GLenum type, GLuint id, GLenum sev, GLsizei len, GLchar const *msg, void const *arg) {
     fprintf(stderr, "OpenGL%s: type=%x sev=%x msg=%s\n", type == GL_DEBUG_TYPE_ERROR ? " ERROR" : "", type, sev, msg);
 }
 
-int main(int argc, char **argv) {
-    // INITIALIZATION //
-    srand(time(NULL));
-    rand();
-
-    // WINDOW INITIALIZATION //
+static int init_graphics(
+    Attrib *block_attrib, Attrib *cutout_attrib, Attrib *player_attrib,
+    Attrib *line_attrib, Attrib *text_attrib)
+{
     if (!glfwInit()) {
-        return -1;
+        return 0;
     }
     create_window();
     if (!g->window) {
         glfwTerminate();
-        return -1;
+        return 0;
     }
 
     glfwMakeContextCurrent(g->window);
@@ -1757,7 +3212,17 @@ int main(int argc, char **argv) {
     glfwSetScrollCallback(g->window, on_scroll);
 
     if (glewInit() != GLEW_OK) {
-        return -1;
+        return 0;
+    }
+    /* chunk meshes live in shared buffers, each drawn through a vertex
+     * array and compacted with glCopyBufferSubData */
+    if (!GLEW_VERSION_3_1 &&
+        !(GLEW_ARB_vertex_array_object && GLEW_ARB_copy_buffer))
+    {
+        fprintf(stderr, "OpenGL 3.1, or ARB_vertex_array_object and "
+            "ARB_copy_buffer, is required; this context is %s\n",
+            glGetString(GL_VERSION));
+        return 0;
     }
 
     glEnable(GL_CULL_FACE);
@@ -1770,13 +3235,27 @@ int main(int argc, char **argv) {
     glDebugMessageCallback(ogl_debug_callback, 0);
 
     // LOAD TEXTURES //
+    /* the block shaders read tiles from an array where they can, so
+     * distant faces get mipmaps without bleeding into other tiles */
+    int texture_array = GLEW_EXT_texture_array;
     GLuint texture;
     glGenTextures(1, &texture);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    load_png_texture("textures/texture.png");
+    if (texture_array) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+            GL_NEAREST_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        atlas_load("textures/texture.png", TEXTURE_CACHE_PATH, 16);
+    }
+    else {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        load_png_texture("textures/texture.png");
+    }
 
     GLuint font;
     glGenTextures(1, &font);
@@ -1797,47 +3276,156 @@ int main(int argc, char **argv) {
     load_png_texture("textures/sky.png");
 
     // LOAD SHADERS //
-    Attrib block_attrib = {0};
-    Attrib line_attrib = {0};
-    Attrib text_attrib = {0};
     GLuint program;
 
-    program = load_program(
-        "shaders/block_vertex.glsl", "shaders/block_fragment.glsl");
-    block_attrib.program = program;
-    block_attrib.position = glGetAttribLocation(program, "position");
-    block_attrib.normal = glGetAttribLocation(program, "normal");
-    block_attrib.uv = glGetAttribLocation(program, "uv");
-    block_attrib.matrix = glGetUniformLocation(program, "matrix");
-    block_attrib.sampler = glGetUniformLocation(program, "texture");
-    block_attrib.camera = glGetUniformLocation(program, "camera");
-    block_attrib.timer = glGetUniformLocation(program, "timer");
-    block_attrib.extra1 = glGetUniformLocation(program, "render_dist");
+    const char *defines = texture_array ? "#define TEXTURE_ARRAY\n" : "";
+    char cutout_defines[64];
+    snprintf(cutout_defines, sizeof(cutout_defines),
+        "%s#define CUTOUT\n", defines);
+
+    program = load_program_defines(
+        "shaders/block_vertex.glsl", "shaders/block_fragment.glsl",
+        defines, 0);
+    block_attrib->program = program;
+    block_attrib->position = glGetAttribLocation(program, "position");
+    block_attrib->normal = glGetAttribLocation(program, "normal");
+    block_attrib->uv = glGetAttribLocation(program, "uv");
+    block_attrib->matrix = glGetUniformLocation(program, "matrix");
+    block_attrib->sampler = glGetUniformLocation(program, "texture");
+    block_attrib->camera = glGetUniformLocation(program, "camera");
+    block_attrib->timer = glGetUniformLocation(program, "timer");
+    block_attrib->extra1 = glGetUniformLocation(program, "render_dist");
+
+    /* the block program, dropping empty texels; it draws from the same
+     * vertex arrays */
+    program = load_program_defines(
+        "shaders/block_vertex.glsl", "shaders/block_fragment.glsl",
+        cutout_defines, block_attrib->program);
+    *cutout_attrib = *block_attrib;
+    cutout_attrib->program = program;
+    cutout_attrib->matrix = glGetUniformLocation(program, "matrix");
+    cutout_attrib->sampler = glGetUniformLocation(program, "texture");
+    cutout_attrib->camera = glGetUniformLocation(program, "camera");
+    cutout_attrib->timer = glGetUniformLocation(program, "timer");
+    cutout_attrib->extra1 = glGetUniformLocation(program, "render_dist");
+
+    program = load_program_defines(
+        "shaders/player_vertex.glsl", "shaders/block_fragment.glsl",
+        defines, 0);
+    player_attrib->program = program;
+    player_attrib->position = glGetAttribLocation(program, "position");
+    player_attrib->normal = glGetAttribLocation(program, "normal");
+    player_attrib->uv = glGetAttribLocation(program, "uv");
+    player_attrib->from = glGetAttribLocation(program, "from");
+    player_attrib->to = glGetAttribLocation(program, "to");
+    player_attrib->angles = glGetAttribLocation(program, "angles");
+    player_attrib->matrix = glGetUniformLocation(program, "matrix");
+    player_attrib->sampler = glGetUniformLocation(program, "texture");
+    player_attrib->camera = glGetUniformLocation(program, "camera");
+    player_attrib->timer = glGetUniformLocation(program, "timer");
+    player_attrib->extra1 = glGetUniformLocation(program, "render_dist");
+    player_attrib->extra2 = glGetUniformLocation(program, "time");
 
     program = load_program(
         "shaders/line_vertex.glsl", "shaders/line_fragment.glsl");
-    line_attrib.program = program;
-    line_attrib.position = glGetAttribLocation(program, "position");
-    line_attrib.matrix = glGetUniformLocation(program, "matrix");
+    line_attrib->program = program;
+    line_attrib->position = glGetAttribLocation(program, "position");
+    line_attrib->matrix = glGetUniformLocation(program, "matrix");
 
     program = load_program(
         "shaders/text_vertex.glsl", "shaders/text_fragment.glsl");
-    text_attrib.program = program;
-    text_attrib.position = glGetAttribLocation(program, "position");
-    text_attrib.uv = glGetAttribLocation(program, "uv");
-    text_attrib.matrix = glGetUniformLocation(program, "matrix");
-    text_attrib.sampler = glGetUniformLocation(program, "sampler");
+    text_attrib->program = program;
+    text_attrib->position = glGetAttribLocation(program, "position");
+    text_attrib->uv = glGetAttribLocation(program, "uv");
+    text_attrib->matrix = glGetUniformLocation(program, "matrix");
+    text_attrib->sampler = glGetUniformLocation(program, "sampler");
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    // INITIALIZATION //
+    srand(time(NULL));
+    rand();
+    trace_init();
+    trace_thread("main");
 
     // CHECK COMMAND LINE ARGUMENTS //
-    if (argc == 2 || argc == 3) {
-        strncpy(g->server_addr, argv[1], MAX_ADDR_LENGTH);
-        g->server_port = argc == 3 ? atoi(argv[2]) : DEFAULT_PORT;
+    int arg = 1;
+    int fast = 0;
+    double duration = 0;
+    char *replay = 0;
+    char *trace = 0;
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--record") == 0 && arg + 1 < argc) {
+            client_record(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--replay") == 0 && arg + 1 < argc) {
+            replay = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--fast") == 0) {
+            fast = 1;
+        }
+        else if (strcmp(argv[arg], "--headless") == 0) {
+            g->headless = 1;
+        }
+        else if (strcmp(argv[arg], "--duration") == 0 && arg + 1 < argc) {
+            duration = atof(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc) {
+            trace = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--profile") == 0 && arg + 1 < argc) {
+            if (!profile_csv_open(argv[++arg])) {
+                fprintf(stderr, "Could not open %s\n", argv[arg]);
+                return 1;
+            }
+        }
+        else {
+            break;
+        }
+    }
+    if (replay && arg == argc) {
+        client_replay(replay, fast);
+        g->replaying = 1;
+        strncpy(g->server_addr, replay, MAX_ADDR_LENGTH);
+    }
+    else if (!replay && (argc - arg == 1 || argc - arg == 2)) {
+        strncpy(g->server_addr, argv[arg], MAX_ADDR_LENGTH);
+        g->server_port = argc - arg == 2 ? atoi(argv[arg + 1]) : DEFAULT_PORT;
     }
     else {
-        fprintf(stderr, "Usage: %s server [port]\n", argv[0]);
+        fprintf(stderr,
+            "Usage: %s [--headless] [--duration SECONDS] [--profile FILE] "
+            "[--trace FILE] [--record FILE] server [port]\n"
+            "       %s [--headless] [--profile FILE] [--trace FILE] "
+            "--replay FILE [--fast]\n",
+            argv[0], argv[0]);
         return 1;
     }
 
+    // WINDOW INITIALIZATION //
+    Attrib block_attrib = {0};
+    Attrib cutout_attrib = {0};
+    Attrib player_attrib = {0};
+    Attrib line_attrib = {0};
+    Attrib text_attrib = {0};
+    if (g->headless) {
+        g->width = WINDOW_WIDTH;
+        g->height = WINDOW_HEIGHT;
+        g->scale = 1;
+        g->fov = 80;
+    }
+    else if (!init_graphics(
+        &block_attrib, &cutout_attrib, &player_attrib,
+        &line_attrib, &text_attrib))
+    {
+        return -1;
+    }
+    else {
+        profile_gpu_init();
+        pool_init(block_attrib.position, block_attrib.normal, block_attrib.uv);
+    }
+
     // INITIALIZE WORKER THREADS
     for (int i = 0; i < WORKERS; i++) {
         Worker *worker = g->workers + i;
@@ -1849,60 +3437,81 @@ int main(int argc, char **argv) {
     }
 
     // OUTER LOOP //
+    double started = get_clock();
     int running = 1;
     while (running) {
         // CLIENT INITIALIZATION //
         client_enable();
         client_connect(g->server_addr, g->server_port);
+        if (!g->replaying) {
+            cache_open(g->server_addr, g->server_port);
+        }
         client_start();
         client_version(2);
+        char codecs[64];
+        codec_list(codecs, sizeof(codecs));
+        client_codecs(codecs);
 
         // LOCAL VARIABLES //
         reset_model();
         resize_world(CHUNK_RADIUS);
+        g->flying = g->headless;
         FPS fps = {0, 0, 0};
-        double last_update = glfwGetTime();
+        double last_update = get_time();
 
         Player *me = g->players;
         State *s = &g->players->state;
         me->id = 0;
         me->name[0] = '\0';
-        me->buffer = 0;
         g->player_count = 1;
 
         // BEGIN MAIN LOOP //
-        double previous = glfwGetTime();
+        double previous = get_time();
+        double frame_start = get_clock();
         while (1) {
             // WINDOW SIZE AND SCALE //
-            g->scale = get_scale_factor();
-            glfwGetFramebufferSize(g->window, &g->width, &g->height);
-            glViewport(0, 0, g->width, g->height);
+            if (!g->headless) {
+                g->scale = get_scale_factor();
+                glfwGetFramebufferSize(g->window, &g->width, &g->height);
+                glViewport(0, 0, g->width, g->height);
+            }
 
             // FRAME RATE //
             if (g->time_changed) {
                 g->time_changed = 0;
-                last_update = glfwGetTime();
+                last_update = get_time();
                 memset(&fps, 0, sizeof(fps));
             }
             update_fps(&fps);
-            double now = glfwGetTime();
+            double clock = get_clock();
+            g->stats.max_frame = MAX(g->stats.max_frame, clock - frame_start);
+            frame_start = clock;
+            double now = get_time();
             double dt = now - previous;
             dt = MIN(dt, 0.2);
             dt = MAX(dt, 0.0);
             previous = now;
 
             // HANDLE MOUSE INPUT //
-            handle_mouse_input();
+            profile_begin(PROFILE_INPUT);
+            if (!g->headless) {
+                handle_mouse_input();
+            }
 
             // HANDLE MOVEMENT //
             handle_movement(dt);
+            profile_end(PROFILE_INPUT);
 
             // HANDLE DATA FROM SERVER //
             size_t size;
             char *buffer = client_recv(&size);
             if (buffer) {
+                double parse_start = get_clock();
+                profile_begin(PROFILE_PARSE);
                 parse_buffer(buffer, size);
                 free(buffer);
+                profile_end(PROFILE_PARSE);
+                g->stats.parse_time += get_clock() - parse_start;
             }
 
             // SEND POSITION TO SERVER //
@@ -1912,81 +3521,149 @@ int main(int argc, char **argv) {
             }
 
             // PREPARE TO RENDER //
+            profile_begin(PROFILE_DELETE);
             delete_chunks();
-
-            // RENDER 3-D SCENE //
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            int face_count = render_world(&block_attrib, me);
-
-            // RENDER HUD //
-            glClear(GL_DEPTH_BUFFER_BIT);
-            if (SHOW_CROSSHAIRS) {
-                render_crosshairs(&line_attrib);
-            }
-
-            // RENDER TEXT //
-            char text_buffer[1024];
-            float ts = 12 * g->scale;
-            float tx = ts / 2;
-            float ty = g->height - ts;
-            if (SHOW_INFO_TEXT) {
-                int hour = time_of_day() * 24;
-                char am_pm = hour < 12 ? 'a' : 'p';
-                hour = hour % 12;
-                hour = !hour && am_pm == 'p' ? 12 : hour;
-                snprintf(
-                    text_buffer, 1024,
-                    "(%d, %d, %d) (%.2f, %.2f, %.2f) [%d, %d, %d] %d%cm %dfps",
-                    chunked(s->x), chunked(s->y), chunked(s->z), s->x, s->y, s->z,
-                    g->player_count, g->chunk_count, face_count,
-                    hour, am_pm, fps.fps);
-                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
-                ty -= ts * 2;
-            }
-            if (SHOW_CHAT_TEXT) {
-                for (int i = 0; i < MAX_MESSAGES; i++) {
-                    int index = (g->message_index + i) % MAX_MESSAGES;
-                    if (strlen(g->messages[index])) {
-                        render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts,
-                            g->messages[index]);
-                        ty -= ts * 2;
-                    }
+            pool_defrag(POOL_DEFRAG_VERTICES);
+            profile_end(PROFILE_DELETE);
+            profile_begin(PROFILE_ENSURE);
+            ensure_chunks(me);
+            profile_end(PROFILE_ENSURE);
+
+            if (g->headless) {
+                /* no vsync to pace the loop */
+                double rest = frame_start + 1.0 / 60 - get_clock();
+                if (rest > 0) {
+                    struct timespec ts = {0, rest * 1e9};
+                    thrd_sleep(&ts, 0);
                 }
             }
-            if (g->typing) {
-                snprintf(text_buffer, 1024, "> %s", g->typing_buffer);
-                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
-                ty -= ts * 2;
-            }
-            if (SHOW_PLAYER_NAMES) {
-                Player *other = player_crosshair(me);
-                if (other) {
-                    render_text(&text_attrib, ALIGN_CENTER,
-                        g->width / 2, g->height / 2 - ts - 24, ts,
-                        other->name);
+            else {
+                // RENDER 3-D SCENE //
+                profile_begin(PROFILE_RENDER);
+                profile_gpu_begin(PROFILE_WORLD);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                int face_count = render_world(
+                    &block_attrib, &cutout_attrib, &player_attrib, me);
+                profile_gpu_end(PROFILE_WORLD);
+                profile_end(PROFILE_RENDER);
+
+                // RENDER HUD //
+                profile_begin(PROFILE_HUD);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                if (SHOW_CROSSHAIRS) {
+                    add_crosshairs();
                 }
-            }
 
-            // SWAP AND POLL //
-            glfwSwapBuffers(g->window);
-            glfwPollEvents();
-            if (glfwWindowShouldClose(g->window)) {
-                running = 0;
-                break;
+                // RENDER TEXT //
+                char text_buffer[1024];
+                float ts = 12 * g->scale;
+                float tx = ts / 2;
+                float ty = g->height - ts;
+                if (SHOW_INFO_TEXT) {
+                    int hour = time_of_day() * 24;
+                    char am_pm = hour < 12 ? 'a' : 'p';
+                    hour = hour % 12;
+                    hour = !hour && am_pm == 'p' ? 12 : hour;
+                    snprintf(
+                        text_buffer, 1024,
+                        "(%d, %d, %d) (%.2f, %.2f, %.2f) [%d, %d, %d] %d%cm %dfps",
+                        chunked(s->x), chunked(s->y), chunked(s->z), s->x, s->y, s->z,
+                        g->player_count, g->chunk_count, face_count,
+                        hour, am_pm, fps.fps);
+                    add_text(ALIGN_LEFT, tx, ty, ts, text_buffer);
+                    ty -= ts * 2;
+                }
+                if (SHOW_CHAT_TEXT) {
+                    for (int i = 0; i < MAX_MESSAGES; i++) {
+                        int index = (g->message_index + i) % MAX_MESSAGES;
+                        if (strlen(g->messages[index])) {
+                            add_text(ALIGN_LEFT, tx, ty, ts,
+                                g->messages[index]);
+                            ty -= ts * 2;
+                        }
+                    }
+                }
+                if (g->typing) {
+                    snprintf(text_buffer, 1024, "> %s", g->typing_buffer);
+                    add_text(ALIGN_LEFT, tx, ty, ts, text_buffer);
+                    ty -= ts * 2;
+                }
+                if (SHOW_PLAYER_NAMES) {
+                    Player *other = player_crosshair(me);
+                    if (other) {
+                        add_text(ALIGN_CENTER,
+                            g->width / 2, g->height / 2 - ts - 24, ts,
+                            other->name);
+                    }
+                }
+                if (g->show_profile) {
+                    add_profile(tx, ty, ts);
+                }
+                render_hud(&line_attrib, &text_attrib);
+                profile_end(PROFILE_HUD);
+
+                // SWAP AND POLL //
+                profile_begin(PROFILE_SWAP);
+                glfwSwapBuffers(g->window);
+                profile_end(PROFILE_SWAP);
+                profile_begin(PROFILE_INPUT);
+                glfwPollEvents();
+                profile_end(PROFILE_INPUT);
+                if (glfwWindowShouldClose(g->window)) {
+                    running = 0;
+                    break;
+                }
             }
+            profile_frame();
             if (g->server_changed) {
                 g->server_changed = 0;
                 break;
             }
+            if (g->replaying || g->headless) {
+                int backlog = meshing_backlog();
+                g->stats.max_backlog = MAX(g->stats.max_backlog, backlog);
+                clock = get_clock();
+                int done = g->replaying ?
+                    client_replay_done() && backlog == 0 :
+                    duration > 0 && clock - started >= duration;
+                if (done) {
+                    report_stats(clock, backlog, 1);
+                    running = 0;
+                    break;
+                }
+                if (clock - g->stats.since >= 1) {
+                    report_stats(clock, backlog, 0);
+                }
+            }
         }
 
         // SHUTDOWN //
         client_stop();
         client_disable();
+        cache_close();
         delete_all_chunks();
         delete_all_players();
     }
 
-    glfwTerminate();
+    client_record(0);
+    cull_free(&g->cull_boxes);
+    free(g->order_keys);
+    free(g->hud_lines);
+    free(g->hud_text);
+
+    profile_csv_close();
+    if (trace) {
+        trace_write(trace);
+    }
+    if (!g->headless) {
+        glstate_delete_vertex_array(g->hud_line_vao);
+        glstate_delete_vertex_array(g->hud_text_vao);
+        glstate_delete_vertex_array(g->player_vao);
+        del_buffer(g->hud_buffer);
+        del_buffer(g->player_buffer);
+        del_buffer(g->player_instances);
+        pool_free_all();
+        glfwTerminate();
+    }
     return 0;
 }
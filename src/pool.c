@@ -0,0 +1,494 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "glstate.h"
+#include "pool.h"
+#include "profile.h"
+#include "util.h"
+
+/* chunk meshes share a few large vertex buffers ("pages") instead of
+ * owning one each; every page has a VAO, and each run of queued ranges
+ * in the same page goes out in a single glMultiDrawArrays */
+
+#define POOL_VERTEX_SIZE (sizeof(GLfloat) * 10)
+#define POOL_PAGES 32
+
+typedef struct {
+    int first;
+    int count;
+} PoolBlock;
+
+typedef struct {
+    GLuint buffer;
+    GLuint vao;
+    PoolBlock *free_blocks; /* sorted by first, never adjacent */
+    int free_count;
+    int free_capacity;
+    int *ids; /* allocations in the page, sorted by first */
+    int id_count;
+    int id_capacity;
+    int used; /* vertices reserved by allocations */
+} PoolPage;
+
+/* a run of queued ranges in one page, drawn with one call */
+typedef struct {
+    int page;
+    int start;
+    int length;
+} PoolBatch;
+
+/* owners hold an id into this table rather than an offset, so the
+ * defragmenter can move a mesh without knowing who owns it; size is what
+ * was reserved, count what the mesh uses of it. page is -1 for a free
+ * id, whose first links to the next free id */
+typedef struct {
+    int page;
+    int first;
+    int size;
+    int count;
+} PoolAlloc;
+
+static PoolPage pages[POOL_PAGES];
+static int page_count = 0;
+static GLint *draw_first = 0;
+static GLsizei *draw_count = 0;
+static int draw_length = 0;
+static int draw_capacity = 0;
+static PoolBatch *batches = 0;
+static int batch_count = 0;
+static int batch_capacity = 0;
+static PoolAlloc *allocs = 0;
+static int alloc_count = 1; /* id 0 means no allocation */
+static int alloc_capacity = 0;
+static int alloc_free = 0;
+static int alloc_live = 0;
+static size_t alloc_used = 0; /* vertices used of the reservations */
+static size_t moved = 0;
+static GLuint attrib_position;
+static GLuint attrib_normal;
+static GLuint attrib_uv;
+
+void pool_init(GLuint position, GLuint normal, GLuint uv) {
+    attrib_position = position;
+    attrib_normal = normal;
+    attrib_uv = uv;
+}
+
+void pool_free_all() {
+    for (int i = 0; i < page_count; i++) {
+        PoolPage *page = pages + i;
+        glstate_delete_vertex_array(page->vao);
+        glDeleteBuffers(1, &page->buffer);
+        free(page->free_blocks);
+        free(page->ids);
+    }
+    memset(pages, 0, sizeof(pages));
+    free(draw_first);
+    free(draw_count);
+    free(batches);
+    draw_first = 0;
+    draw_count = 0;
+    batches = 0;
+    draw_length = draw_capacity = 0;
+    batch_count = batch_capacity = 0;
+    page_count = 0;
+    free(allocs);
+    allocs = 0;
+    alloc_count = 1;
+    alloc_capacity = 0;
+    alloc_free = 0;
+    alloc_live = 0;
+    alloc_used = 0;
+}
+
+/* TLSF-style size classes: eight steps per power of two, so a mesh
+ * wastes at most an eighth of its reservation, and a remesh that grows
+ * a little usually still fits where it is */
+static int size_class(int count) {
+    int step = 8;
+    while (step * 16 <= count) {
+        step <<= 1;
+    }
+    return (count + step - 1) / step * step;
+}
+
+static void insert_block(PoolPage *page, int index, int first, int count) {
+    if (page->free_count == page->free_capacity) {
+        page->free_capacity = page->free_capacity ? page->free_capacity * 2 : 64;
+        page->free_blocks = realloc(
+            page->free_blocks, sizeof(PoolBlock) * page->free_capacity);
+    }
+    memmove(page->free_blocks + index + 1, page->free_blocks + index,
+        sizeof(PoolBlock) * (page->free_count - index));
+    page->free_blocks[index].first = first;
+    page->free_blocks[index].count = count;
+    page->free_count++;
+}
+
+static void remove_block(PoolPage *page, int index) {
+    page->free_count--;
+    memmove(page->free_blocks + index, page->free_blocks + index + 1,
+        sizeof(PoolBlock) * (page->free_count - index));
+}
+
+static void take_block(PoolPage *page, int index, int count) {
+    PoolBlock *block = page->free_blocks + index;
+    block->first += count;
+    block->count -= count;
+    if (!block->count) {
+        remove_block(page, index);
+    }
+    page->used += count;
+}
+
+static void release_block(PoolPage *page, int first, int count) {
+    page->used -= count;
+    int index = 0;
+    while (index < page->free_count &&
+        page->free_blocks[index].first < first)
+    {
+        index++;
+    }
+    if (index > 0) {
+        PoolBlock *prev = page->free_blocks + index - 1;
+        if (prev->first + prev->count == first) {
+            first = prev->first;
+            count += prev->count;
+            remove_block(page, --index);
+        }
+    }
+    if (index < page->free_count) {
+        PoolBlock *next = page->free_blocks + index;
+        if (first + count == next->first) {
+            count += next->count;
+            remove_block(page, index);
+        }
+    }
+    insert_block(page, index, first, count);
+}
+
+/* where the allocation starting at first is, or would go, in the page's
+ * list */
+static int find_id(PoolPage *page, int first) {
+    int lo = 0;
+    int hi = page->id_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (allocs[page->ids[mid]].first < first) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void add_id(PoolPage *page, int id) {
+    if (page->id_count == page->id_capacity) {
+        page->id_capacity = page->id_capacity ? page->id_capacity * 2 : 64;
+        page->ids = realloc(page->ids, sizeof(int) * page->id_capacity);
+    }
+    int index = find_id(page, allocs[id].first);
+    memmove(page->ids + index + 1, page->ids + index,
+        sizeof(int) * (page->id_count - index));
+    page->ids[index] = id;
+    page->id_count++;
+}
+
+static void remove_id(PoolPage *page, int id) {
+    int index = find_id(page, allocs[id].first);
+    page->id_count--;
+    memmove(page->ids + index, page->ids + index + 1,
+        sizeof(int) * (page->id_count - index));
+}
+
+/* end of the highest allocation in the page */
+static int page_top(PoolPage *page) {
+    if (page->free_count) {
+        PoolBlock *last = page->free_blocks + page->free_count - 1;
+        if (last->first + last->count == POOL_PAGE_VERTICES) {
+            return last->first;
+        }
+    }
+    return POOL_PAGE_VERTICES;
+}
+
+static PoolPage *add_page() {
+    if (page_count == POOL_PAGES) {
+        return 0;
+    }
+    PoolPage *page = pages + page_count++;
+    glGenBuffers(1, &page->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, page->buffer);
+    glBufferData(GL_ARRAY_BUFFER, POOL_PAGE_VERTICES * POOL_VERTEX_SIZE,
+        NULL, GL_DYNAMIC_DRAW);
+    glGenVertexArrays(1, &page->vao);
+    glstate_bind_vertex_array(page->vao);
+    glEnableVertexAttribArray(attrib_position);
+    glEnableVertexAttribArray(attrib_normal);
+    glEnableVertexAttribArray(attrib_uv);
+    glVertexAttribPointer(attrib_position, 3, GL_FLOAT, GL_FALSE,
+        POOL_VERTEX_SIZE, 0);
+    glVertexAttribPointer(attrib_normal, 3, GL_FLOAT, GL_FALSE,
+        POOL_VERTEX_SIZE, (GLvoid *)(sizeof(GLfloat) * 3));
+    glVertexAttribPointer(attrib_uv, 4, GL_FLOAT, GL_FALSE,
+        POOL_VERTEX_SIZE, (GLvoid *)(sizeof(GLfloat) * 6));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    insert_block(page, 0, 0, POOL_PAGE_VERTICES);
+    return page;
+}
+
+/* drops trailing pages nothing lives in any more */
+static void trim_pages() {
+    while (page_count > 1 && !pages[page_count - 1].used) {
+        PoolPage *page = pages + --page_count;
+        glstate_delete_vertex_array(page->vao);
+        glDeleteBuffers(1, &page->buffer);
+        free(page->free_blocks);
+        free(page->ids);
+        memset(page, 0, sizeof(PoolPage));
+    }
+}
+
+/* best fit over every page, lowest address on ties, so meshes pack
+ * towards the front of the pool */
+static int find_block(int size, int *page_index, int *block_index) {
+    int best = 0;
+    for (int i = 0; i < page_count; i++) {
+        PoolPage *page = pages + i;
+        for (int j = 0; j < page->free_count; j++) {
+            int count = page->free_blocks[j].count;
+            if (count < size || (best && count >= best)) {
+                continue;
+            }
+            best = count;
+            *page_index = i;
+            *block_index = j;
+        }
+    }
+    return best != 0;
+}
+
+static int new_id() {
+    if (alloc_free) {
+        int id = alloc_free;
+        alloc_free = allocs[id].first;
+        return id;
+    }
+    if (alloc_count >= alloc_capacity) {
+        alloc_capacity = alloc_capacity ? alloc_capacity * 2 : 1024;
+        allocs = realloc(allocs, sizeof(PoolAlloc) * alloc_capacity);
+    }
+    return alloc_count++;
+}
+
+static void free_id(int id) {
+    allocs[id].page = -1;
+    allocs[id].first = alloc_free;
+    alloc_free = id;
+}
+
+void pool_free(PoolRange *range) {
+    if (!range->id) {
+        return;
+    }
+    PoolAlloc *a = allocs + range->id;
+    remove_id(pages + a->page, range->id);
+    release_block(pages + a->page, a->first, a->size);
+    alloc_used -= a->count;
+    free_id(range->id);
+    range->id = 0;
+    alloc_live--;
+}
+
+/* (re)allocates room for count vertices; a range that still fits its
+ * reservation stays where it is. returns 0 if the pool is exhausted */
+int pool_alloc(PoolRange *range, int count) {
+    if (range->id) {
+        PoolAlloc *a = allocs + range->id;
+        if (count && count <= a->size && size_class(count) * 2 > a->size) {
+            alloc_used += count - a->count;
+            a->count = count;
+            return 1;
+        }
+        pool_free(range);
+    }
+    if (count <= 0 || count > POOL_PAGE_VERTICES) {
+        return count == 0;
+    }
+    int size = MIN(size_class(count), POOL_PAGE_VERTICES);
+    int page_index, block_index;
+    if (!find_block(size, &page_index, &block_index)) {
+        if (!add_page()) {
+            return 0;
+        }
+        page_index = page_count - 1;
+        block_index = 0;
+    }
+    PoolPage *page = pages + page_index;
+    int id = new_id();
+    PoolAlloc *a = allocs + id;
+    a->page = page_index;
+    a->first = page->free_blocks[block_index].first;
+    a->size = size;
+    a->count = count;
+    take_block(page, block_index, size);
+    add_id(page, id);
+    range->id = id;
+    alloc_live++;
+    alloc_used += count;
+    return 1;
+}
+
+void pool_upload(PoolRange *range, const GLfloat *data) {
+    if (!range->id) {
+        return;
+    }
+    PoolAlloc *a = allocs + range->id;
+    GLsizeiptr size = a->count * POOL_VERTEX_SIZE;
+    glBindBuffer(GL_ARRAY_BUFFER, pages[a->page].buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, a->first * POOL_VERTEX_SIZE,
+        size, data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    profile_count(PROFILE_UPLOADED, size);
+}
+
+/* moves the highest allocation of the highest page that has one able to
+ * go lower, copying on the GPU; returns the vertices moved, 0 if none
+ * could */
+static int move_one() {
+    for (int i = page_count - 1; i >= 0; i--) {
+        if (!pages[i].id_count) {
+            continue;
+        }
+        int top = pages[i].ids[pages[i].id_count - 1];
+        PoolAlloc *a = allocs + top;
+        for (int j = 0; j <= i; j++) {
+            PoolPage *page = pages + j;
+            for (int k = 0; k < page->free_count; k++) {
+                PoolBlock *block = page->free_blocks + k;
+                if (j == i && block->first > a->first) {
+                    break;
+                }
+                if (block->count < a->size) {
+                    continue;
+                }
+                int first = block->first;
+                glBindBuffer(GL_COPY_READ_BUFFER, pages[i].buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, page->buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                    a->first * POOL_VERTEX_SIZE, first * POOL_VERTEX_SIZE,
+                    a->count * POOL_VERTEX_SIZE);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                remove_id(pages + i, top);
+                take_block(page, k, a->size);
+                release_block(pages + i, a->first, a->size);
+                a->page = j;
+                a->first = first;
+                add_id(page, top);
+                moved += a->count * POOL_VERTEX_SIZE;
+                return a->size;
+            }
+        }
+    }
+    return 0;
+}
+
+/* gives back pages left empty, then, once holes make up more than a
+ * quarter of the space below each page's top, compacts meshes towards
+ * the front of the pool, at most budget vertices a call. deciding takes
+ * only each page's top and running total */
+void pool_defrag(int budget) {
+    trim_pages();
+    int span = 0;
+    int used = 0;
+    for (int i = 0; i < page_count; i++) {
+        span += page_top(pages + i);
+        used += pages[i].used;
+    }
+    if ((span - used) * 4 <= span) {
+        return;
+    }
+    while (budget > 0) {
+        int count = move_one();
+        if (!count) {
+            break;
+        }
+        budget -= count;
+    }
+    trim_pages();
+}
+
+void pool_stats(PoolStats *stats) {
+    memset(stats, 0, sizeof(PoolStats));
+    stats->pages = page_count;
+    stats->allocations = alloc_live;
+    stats->used = alloc_used * POOL_VERTEX_SIZE;
+    for (int i = 0; i < page_count; i++) {
+        PoolPage *page = pages + i;
+        int top = page_top(page);
+        stats->reserved += page->used * POOL_VERTEX_SIZE;
+        stats->span += top * POOL_VERTEX_SIZE;
+        stats->holes += (top - page->used) * POOL_VERTEX_SIZE;
+        for (int j = 0; j < page->free_count; j++) {
+            stats->largest = MAX(stats->largest,
+                page->free_blocks[j].count * POOL_VERTEX_SIZE);
+        }
+    }
+    stats->capacity = page_count * POOL_PAGE_VERTICES * POOL_VERTEX_SIZE;
+    stats->moved = moved;
+}
+
+void pool_draw_begin() {
+    draw_length = 0;
+    batch_count = 0;
+}
+
+/* queues count vertices from first within the range. ranges are drawn in
+ * the order they are queued; a range in another page than the one before
+ * it starts a new batch */
+void pool_draw_add(PoolRange *range, int first, int count) {
+    if (!range->id) {
+        return;
+    }
+    PoolAlloc *a = allocs + range->id;
+    count = MIN(count, a->count - first);
+    if (count <= 0) {
+        return;
+    }
+    if (draw_length == draw_capacity) {
+        draw_capacity = draw_capacity ? draw_capacity * 2 : 1024;
+        draw_first = realloc(draw_first, sizeof(GLint) * draw_capacity);
+        draw_count = realloc(draw_count, sizeof(GLsizei) * draw_capacity);
+    }
+    if (!batch_count || batches[batch_count - 1].page != a->page) {
+        if (batch_count == batch_capacity) {
+            batch_capacity = batch_capacity ? batch_capacity * 2 : 64;
+            batches = realloc(batches, sizeof(PoolBatch) * batch_capacity);
+        }
+        PoolBatch *batch = batches + batch_count++;
+        batch->page = a->page;
+        batch->start = draw_length;
+        batch->length = 0;
+    }
+    draw_first[draw_length] = a->first + first;
+    draw_count[draw_length] = count;
+    draw_length++;
+    batches[batch_count - 1].length++;
+}
+
+/* one draw call per batch, in queue order; returns the calls made */
+int pool_draw_end() {
+    for (int i = 0; i < batch_count; i++) {
+        PoolBatch *batch = batches + i;
+        glstate_bind_vertex_array(pages[batch->page].vao);
+        glMultiDrawArrays(GL_TRIANGLES,
+            draw_first + batch->start, draw_count + batch->start,
+            batch->length);
+    }
+    profile_count(PROFILE_DRAWS, batch_count);
+    return batch_count;
+}
@@ -0,0 +1,37 @@
+#ifndef _pool_h_
+#define _pool_h_
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+/* a mesh's handle into the pool; zero means it has no vertices there */
+typedef struct {
+    int id;
+} PoolRange;
+
+/* sizes in bytes; holes is free space below the highest allocation of
+ * each page, out of span */
+typedef struct {
+    int pages;
+    int allocations;
+    size_t used;
+    size_t reserved;
+    size_t capacity;
+    size_t span;
+    size_t holes;
+    size_t largest;
+    size_t moved;
+} PoolStats;
+
+void pool_init(GLuint position, GLuint normal, GLuint uv);
+void pool_free_all();
+int pool_alloc(PoolRange *range, int count);
+void pool_free(PoolRange *range);
+void pool_upload(PoolRange *range, const GLfloat *data);
+void pool_defrag(int budget);
+void pool_stats(PoolStats *stats);
+void pool_draw_begin();
+void pool_draw_add(PoolRange *range, int first, int count);
+int pool_draw_end();
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+#include "trace.h"
+#include "util.h"
+
+#define PROFILE_SERIES (PROFILE_PHASES + PROFILE_COUNTERS)
+
+static const char *phase_names[PROFILE_PHASES] = {
+    "input", "parse", "delete", "ensure", "render", "hud", "swap", "frame"
+};
+
+static const char *counter_names[PROFILE_COUNTERS] = {
+    "meshed", "uploaded", "draws"
+};
+
+static const char *pass_names[PROFILE_PASSES] = {
+    "world", "crosshair", "text"
+};
+
+/* the current frame's totals, then a ring of past frames; phases are in
+ * seconds, counters in whatever unit they're counted in */
+static double started[PROFILE_PHASES];
+static double current[PROFILE_SERIES];
+static double history[PROFILE_SERIES][PROFILE_HISTORY];
+static int history_index = 0;
+static int history_count = 0;
+static double last_frame = 0;
+static long frame_index = 0;
+static FILE *csv = 0;
+
+/* GL_TIME_ELAPSED queries, a ring of PROFILE_GPU_FRAMES frames so results
+ * are read a few frames late instead of stalling on them; results land in
+ * their own history as they arrive */
+static int gpu_supported = 0;
+static GLuint queries[PROFILE_GPU_FRAMES][PROFILE_PASSES];
+static int pending[PROFILE_GPU_FRAMES][PROFILE_PASSES];
+static int gpu_frame = 0;
+static double gpu_latest[PROFILE_PASSES];
+static double gpu_history[PROFILE_PASSES][PROFILE_HISTORY];
+static int gpu_index[PROFILE_PASSES];
+static int gpu_count[PROFILE_PASSES];
+
+void profile_begin(int phase) {
+    started[phase] = get_clock();
+}
+
+void profile_end(int phase) {
+    double now = get_clock();
+    current[phase] += now - started[phase];
+    trace_event(phase_names[phase], started[phase], now);
+}
+
+void profile_count(int counter, int amount) {
+    current[PROFILE_PHASES + counter] += amount;
+}
+
+int profile_gpu_init() {
+    gpu_supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (gpu_supported) {
+        glGenQueries(PROFILE_GPU_FRAMES * PROFILE_PASSES, queries[0]);
+    }
+    return gpu_supported;
+}
+
+void profile_gpu_begin(int pass) {
+    if (!gpu_supported || pending[gpu_frame][pass]) {
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[gpu_frame][pass]);
+}
+
+void profile_gpu_end(int pass) {
+    if (!gpu_supported || pending[gpu_frame][pass]) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[gpu_frame][pass] = 1;
+}
+
+/* collects whatever results are ready without waiting; a slot still
+ * pending when the ring comes back around is skipped that frame */
+static void gpu_collect() {
+    for (int i = 0; i < PROFILE_GPU_FRAMES; i++) {
+        for (int j = 0; j < PROFILE_PASSES; j++) {
+            if (!pending[i][j]) {
+                continue;
+            }
+            GLuint available = 0;
+            glGetQueryObjectuiv(
+                queries[i][j], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[i][j], GL_QUERY_RESULT, &elapsed);
+            pending[i][j] = 0;
+            gpu_latest[j] = elapsed * 1e-9;
+            gpu_history[j][gpu_index[j]] = gpu_latest[j];
+            gpu_index[j] = (gpu_index[j] + 1) % PROFILE_HISTORY;
+            gpu_count[j] = MIN(gpu_count[j] + 1, PROFILE_HISTORY);
+        }
+    }
+    gpu_frame = (gpu_frame + 1) % PROFILE_GPU_FRAMES;
+}
+
+/* closes the frame, moving its totals into the history */
+void profile_frame() {
+    double now = get_clock();
+    if (last_frame) {
+        current[PROFILE_FRAME] = now - last_frame;
+    }
+    last_frame = now;
+    if (gpu_supported) {
+        gpu_collect();
+    }
+    for (int i = 0; i < PROFILE_SERIES; i++) {
+        history[i][history_index] = current[i];
+    }
+    history_index = (history_index + 1) % PROFILE_HISTORY;
+    history_count = MIN(history_count + 1, PROFILE_HISTORY);
+    if (csv) {
+        fprintf(csv, "%ld", frame_index);
+        for (int i = 0; i < PROFILE_PHASES; i++) {
+            fprintf(csv, ",%.3f", current[i] * 1000);
+        }
+        for (int i = 0; i < PROFILE_PASSES; i++) {
+            fprintf(csv, ",%.3f", gpu_latest[i] * 1000);
+        }
+        for (int i = 0; i < PROFILE_COUNTERS; i++) {
+            fprintf(csv, ",%.0f", current[PROFILE_PHASES + i]);
+        }
+        fprintf(csv, "\n");
+    }
+    memset(current, 0, sizeof(current));
+    frame_index++;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void percentiles(const double *samples, int n, double *p50, double *p99) {
+    double sorted[PROFILE_HISTORY];
+    if (!n) {
+        *p50 = *p99 = 0;
+        return;
+    }
+    memcpy(sorted, samples, sizeof(double) * n);
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    *p50 = sorted[n / 2];
+    *p99 = sorted[MIN(n - 1, n * 99 / 100)];
+}
+
+/* rolling percentiles over the last PROFILE_HISTORY frames, in ms */
+void profile_phase(int phase, double *p50, double *p99) {
+    percentiles(history[phase], history_count, p50, p99);
+    *p50 *= 1000;
+    *p99 *= 1000;
+}
+
+void profile_counter(int counter, double *p50, double *p99) {
+    percentiles(
+        history[PROFILE_PHASES + counter], history_count, p50, p99);
+}
+
+/* GPU time per pass, over its last PROFILE_HISTORY results; returns 0
+ * if the context can't time passes */
+int profile_gpu(int pass, double *p50, double *p99) {
+    percentiles(gpu_history[pass], gpu_count[pass], p50, p99);
+    *p50 *= 1000;
+    *p99 *= 1000;
+    return gpu_supported;
+}
+
+const char *profile_phase_name(int phase) {
+    return phase_names[phase];
+}
+
+const char *profile_counter_name(int counter) {
+    return counter_names[counter];
+}
+
+const char *profile_pass_name(int pass) {
+    return pass_names[pass];
+}
+
+/* streams one row per frame, phases in ms, until closed */
+int profile_csv_open(const char *path) {
+    profile_csv_close();
+    csv = fopen(path, "w");
+    if (!csv) {
+        return 0;
+    }
+    fprintf(csv, "index");
+    for (int i = 0; i < PROFILE_PHASES; i++) {
+        fprintf(csv, ",%s", phase_names[i]);
+    }
+    for (int i = 0; i < PROFILE_PASSES; i++) {
+        fprintf(csv, ",gpu_%s", pass_names[i]);
+    }
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        fprintf(csv, ",%s", counter_names[i]);
+    }
+    fprintf(csv, "\n");
+    return 1;
+}
+
+void profile_csv_close() {
+    if (csv) {
+        fclose(csv);
+        csv = 0;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _profile_h_
+#define _profile_h_
+
+/* phases of a frame on the main thread */
+#define PROFILE_INPUT 0
+#define PROFILE_PARSE 1
+#define PROFILE_DELETE 2
+#define PROFILE_ENSURE 3
+#define PROFILE_RENDER 4
+#define PROFILE_HUD 5
+#define PROFILE_SWAP 6
+#define PROFILE_FRAME 7
+#define PROFILE_PHASES 8
+
+/* per-frame counters */
+#define PROFILE_MESHED 0
+#define PROFILE_UPLOADED 1
+#define PROFILE_DRAWS 2
+#define PROFILE_COUNTERS 3
+
+/* render passes timed on the GPU */
+#define PROFILE_WORLD 0
+#define PROFILE_CROSSHAIR 1
+#define PROFILE_TEXT 2
+#define PROFILE_PASSES 3
+#define PROFILE_GPU_FRAMES 4
+
+#define PROFILE_HISTORY 256
+
+void profile_begin(int phase);
+void profile_end(int phase);
+void profile_count(int counter, int amount);
+void profile_frame();
+void profile_phase(int phase, double *p50, double *p99);
+void profile_counter(int counter, double *p50, double *p99);
+int profile_gpu_init();
+void profile_gpu_begin(int pass);
+void profile_gpu_end(int pass);
+int profile_gpu(int pass, double *p50, double *p99);
+const char *profile_phase_name(int phase);
+const char *profile_counter_name(int counter);
+const char *profile_pass_name(int pass);
+int profile_csv_open(const char *path);
+void profile_csv_close();
+
+#endif
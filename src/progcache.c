@@ -0,0 +1,129 @@
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 200809L
+    #include <sys/stat.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "progcache.h"
+
+#define PROGCACHE_MAGIC 0x50524731 /* "PRG1" */
+
+/* followed by the binary, as glGetProgramBinary gave it */
+typedef struct {
+    unsigned int magic;
+    unsigned int format;
+    unsigned int length;
+    unsigned int reserved;
+    unsigned long long key;
+} ProgcacheHeader;
+
+/* whether the driver can hand back programs it has linked; checked once,
+ * as the answer can't change for the context */
+int progcache_enabled() {
+    static int enabled = -1;
+    if (enabled < 0) {
+        GLint formats = 0;
+        if (USE_PROGRAM_CACHE &&
+            (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+        {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        enabled = formats > 0;
+    }
+    return enabled;
+}
+
+/* fnv-1a over each part and its terminating zero, so parts can't run
+ * into each other; a missing part hashes as empty */
+unsigned long long progcache_key(const char **parts, int count) {
+    unsigned long long h = 14695981039346656037ull;
+    for (int i = 0; i < count; i++) {
+        const char *part = parts[i] ? parts[i] : "";
+        do {
+            h = (h ^ (unsigned char)*part) * 1099511628211ull;
+        } while (*part++);
+    }
+    return h;
+}
+
+static void progcache_path(char *path, size_t size, unsigned long long key) {
+    snprintf(path, size, "%s.%016llx", PROGRAM_CACHE_PATH, key);
+}
+
+/* returns a linked program, or 0 if there's none cached or the driver
+ * turns it down, e.g. after an update */
+GLuint progcache_load(unsigned long long key) {
+    if (!progcache_enabled()) {
+        return 0;
+    }
+    char path[1024];
+    progcache_path(path, sizeof(path), key);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    GLuint program = 0;
+    ProgcacheHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == PROGCACHE_MAGIC && header.key == key)
+    {
+        void *binary = malloc(header.length ? header.length : 1);
+        if (fread(binary, 1, header.length, file) == header.length) {
+            program = glCreateProgram();
+            glProgramBinary(program, header.format, binary, header.length);
+            GLint status;
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+            if (status == GL_FALSE) {
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+        free(binary);
+    }
+    fclose(file);
+    return program;
+}
+
+void progcache_store(unsigned long long key, GLuint program) {
+    if (!progcache_enabled()) {
+        return;
+    }
+    GLint status;
+    GLint length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (status == GL_FALSE || length <= 0) {
+        return;
+    }
+    ProgcacheHeader header = {PROGCACHE_MAGIC, 0, 0, 0, key};
+    void *binary = malloc(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, binary);
+    header.format = format;
+    header.length = written;
+#ifndef _WIN32
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", PROGRAM_CACHE_PATH);
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+    }
+#endif
+    char path[1024];
+    progcache_path(path, sizeof(path), key);
+    FILE *file = written > 0 ? fopen(path, "wb") : 0;
+    if (file) {
+        if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+            fwrite(binary, 1, written, file) != (size_t)written)
+        {
+            fprintf(stderr, "program cache %s not written\n", path);
+        }
+        fclose(file);
+    }
+    free(binary);
+}
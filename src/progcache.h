@@ -0,0 +1,13 @@
+#ifndef _progcache_h_
+#define _progcache_h_
+
+#include <GL/glew.h>
+
+/* linked program binaries kept on disk, keyed by a hash of everything
+ * that went into them */
+int progcache_enabled();
+unsigned long long progcache_key(const char **parts, int count);
+GLuint progcache_load(unsigned long long key);
+void progcache_store(unsigned long long key, GLuint program);
+
+#endif
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "tinycthread.h"
+#include "trace.h"
+#include "util.h"
+
+#define TRACE_THREADS 64
+
+typedef struct {
+    const char *name;
+    double start;
+    double end;
+    int p;
+    int q;
+    int r;
+    int chunk;
+} TraceEvent;
+
+/* each thread appends to its own ring, so recording takes no lock. the
+ * count only ever grows; it is stored with release after each event is
+ * written, and a release fence keeps it ahead of the next event's
+ * writes, so a reader that loads it with acquire sees whole events and
+ * can tell which it may have caught being overwritten */
+typedef struct {
+    char name[32];
+    int tid;
+    unsigned int count;
+    TraceEvent events[TRACE_EVENTS];
+} TraceBuffer;
+
+static mtx_t mutex;
+static TraceBuffer *buffers[TRACE_THREADS];
+static int buffer_count = 0; /* published like count */
+static double base = 0;
+static _Thread_local TraceBuffer *local = 0;
+
+void trace_init() {
+    mtx_init(&mutex, mtx_plain);
+    base = get_clock();
+}
+
+/* gives the calling thread a buffer; threads that never call this
+ * record nothing */
+void trace_thread(const char *name) {
+    if (!USE_TRACE || local) {
+        return;
+    }
+    mtx_lock(&mutex);
+    if (buffer_count < TRACE_THREADS) {
+        TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+        snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+        buffer->tid = buffer_count + 1;
+        buffers[buffer_count] = buffer;
+        __atomic_store_n(&buffer_count, buffer_count + 1, __ATOMIC_RELEASE);
+        local = buffer;
+    }
+    mtx_unlock(&mutex);
+}
+
+static void record(
+    const char *name, double start, double end,
+    int p, int q, int r, int chunk)
+{
+    TraceBuffer *buffer = local;
+    if (!buffer) {
+        return;
+    }
+    unsigned int count = __atomic_load_n(&buffer->count, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    TraceEvent *event = buffer->events + count % TRACE_EVENTS;
+    event->name = name;
+    event->start = start;
+    event->end = end;
+    event->p = p;
+    event->q = q;
+    event->r = r;
+    event->chunk = chunk;
+    __atomic_store_n(&buffer->count, count + 1, __ATOMIC_RELEASE);
+}
+
+/* names must be string literals, or otherwise outlive the trace */
+void trace_event(const char *name, double start, double end) {
+    record(name, start, end, 0, 0, 0, 0);
+}
+
+void trace_chunk(
+    const char *name, double start, double end, int p, int q, int r)
+{
+    record(name, start, end, p, q, r, 1);
+}
+
+/* writes the newest events of every thread as Chrome trace JSON, for
+ * chrome://tracing or Perfetto; safe while the other threads record */
+int trace_write(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return 0;
+    }
+    TraceEvent *events = malloc(sizeof(TraceEvent) * TRACE_EVENTS);
+    fprintf(file, "{\"traceEvents\":[\n");
+    int first = 1;
+    int count = __atomic_load_n(&buffer_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        TraceBuffer *buffer = buffers[i];
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", buffer->tid, buffer->name);
+        first = 0;
+        unsigned int end = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+        unsigned int start = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+        for (unsigned int j = start; j < end; j++) {
+            events[j - start] = buffer->events[j % TRACE_EVENTS];
+        }
+        /* drop whatever the owner overwrote while we copied, and the
+         * slot it may be writing now */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        unsigned int after =
+            __atomic_load_n(&buffer->count, __ATOMIC_RELAXED);
+        if (after + 1 > start + TRACE_EVENTS) {
+            start = MIN(end, after + 1 - TRACE_EVENTS);
+        }
+        unsigned int copied = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+        for (unsigned int j = start; j < end; j++) {
+            TraceEvent *event = events + (j - copied);
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                "\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f",
+                event->name, buffer->tid, (event->start - base) * 1e6,
+                (event->end - event->start) * 1e6);
+            if (event->chunk) {
+                fprintf(file, ",\"args\":{\"p\":%d,\"q\":%d,\"r\":%d}",
+                    event->p, event->q, event->r);
+            }
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+    free(events);
+    fclose(file);
+    return 1;
+}
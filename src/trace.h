@@ -0,0 +1,11 @@
+#ifndef _trace_h_
+#define _trace_h_
+
+void trace_init();
+void trace_thread(const char *name);
+void trace_event(const char *name, double start, double end);
+void trace_chunk(
+    const char *name, double start, double end, int p, int q, int r);
+int trace_write(const char *path);
+
+#endif
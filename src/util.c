@@ -4,6 +4,9 @@
 #include <errno.h>
 #include "lodepng.h"
 #include "matrix.h"
+#include "profile.h"
+#include "progcache.h"
+#include "tinycthread.h"
 #include "util.h"
 
 int rand_int(int n) {
@@ -18,7 +21,7 @@ double rand_double() {
 
 void update_fps(FPS *fps) {
     fps->frames++;
-    double now = glfwGetTime();
+    double now = get_clock();
     double elapsed = now - fps->since;
     if (elapsed >= 1) {
         fps->fps = round(fps->frames / elapsed);
@@ -27,6 +30,37 @@ void update_fps(FPS *fps) {
     }
 }
 
+/* seconds from a steady clock, unaffected by the server's day clock or
+ * changes to the system time */
+double get_clock() {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    clock_gettime(TIME_UTC, &ts);
+#endif
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* resident set size in bytes, or 0 where it can't be read */
+size_t get_rss() {
+    size_t result = 0;
+    FILE *file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return 0;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long kb;
+        if (sscanf(line, "VmRSS: %lu kB", &kb) == 1) {
+            result = (size_t)kb * 1024;
+            break;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
 char *load_file(const char *path) {
     FILE *file = fopen(path, "rb");
     if (!file) {
@@ -48,11 +82,15 @@ GLuint gen_buffer(GLsizei size, GLfloat *data) {
     glBindBuffer(GL_ARRAY_BUFFER, buffer);
     glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    profile_count(PROFILE_UPLOADED, size);
     return buffer;
 }
 
 void del_buffer(GLuint buffer) {
-    glDeleteBuffers(1, &buffer);
+    /* a no-op for 0, which is all there is without a GL context */
+    if (buffer) {
+        glDeleteBuffers(1, &buffer);
+    }
 }
 
 GLfloat *malloc_faces(int components, int faces) {
@@ -90,10 +128,48 @@ GLuint load_shader(GLenum type, const char *path) {
     return result;
 }
 
+/* a shader's source with defines, whole lines, put in after its #version */
+static char *load_source(const char *path, const char *defines) {
+    char *data = load_file(path);
+    char *body = strchr(data, '\n');
+    body = body ? body + 1 : data + strlen(data);
+    size_t head = body - data;
+    char *source = malloc(strlen(data) + strlen(defines) + 1);
+    memcpy(source, data, head);
+    strcpy(source + head, defines);
+    strcat(source, body);
+    free(data);
+    return source;
+}
+
 GLuint make_program(GLuint shader1, GLuint shader2) {
+    return make_program_like(shader1, shader2, 0);
+}
+
+/* links a program with its attributes where another program, if any, has
+ * them, so the two can draw from the same vertex arrays */
+GLuint make_program_like(GLuint shader1, GLuint shader2, GLuint like) {
     GLuint program = glCreateProgram();
     glAttachShader(program, shader1);
     glAttachShader(program, shader2);
+    GLint attributes = 0;
+    if (like) {
+        glGetProgramiv(like, GL_ACTIVE_ATTRIBUTES, &attributes);
+    }
+    for (GLint i = 0; i < attributes; i++) {
+        GLchar name[64];
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(like, i, sizeof(name), NULL, &size, &type, name);
+        GLint location = glGetAttribLocation(like, name);
+        if (location >= 0) {
+            glBindAttribLocation(program, location, name);
+        }
+    }
+    if (progcache_enabled()) {
+        glProgramParameteri(
+            program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(program);
     GLint status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -113,9 +189,33 @@ GLuint make_program(GLuint shader1, GLuint shader2) {
 }
 
 GLuint load_program(const char *path1, const char *path2) {
-    GLuint shader1 = load_shader(GL_VERTEX_SHADER, path1);
-    GLuint shader2 = load_shader(GL_FRAGMENT_SHADER, path2);
-    GLuint program = make_program(shader1, shader2);
+    return load_program_defines(path1, path2, "", 0);
+}
+
+/* like make_program_like on the two shaders loaded with defines, but
+ * taken from the program cache when the same driver has linked the same
+ * sources before, which saves compiling them */
+GLuint load_program_defines(
+    const char *path1, const char *path2, const char *defines, GLuint like)
+{
+    char *source1 = load_source(path1, defines);
+    char *source2 = load_source(path2, defines);
+    const char *parts[] = {
+        source1, source2,
+        (const char *)glGetString(GL_VENDOR),
+        (const char *)glGetString(GL_RENDERER),
+        (const char *)glGetString(GL_VERSION)
+    };
+    unsigned long long key = progcache_key(parts, 5);
+    GLuint program = progcache_load(key);
+    if (!program) {
+        program = make_program_like(
+            make_shader(GL_VERTEX_SHADER, source1),
+            make_shader(GL_FRAGMENT_SHADER, source2), like);
+        progcache_store(key, program);
+    }
+    free(source1);
+    free(source2);
     return program;
 }
 
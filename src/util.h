@@ -3,6 +3,7 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <stddef.h>
 #include "config.h"
 
 #define PI 3.14159265359
@@ -28,6 +29,8 @@ typedef struct {
 int rand_int(int n);
 double rand_double();
 void update_fps(FPS *fps);
+double get_clock();
+size_t get_rss();
 
 GLuint gen_buffer(GLsizei size, GLfloat *data);
 void del_buffer(GLuint buffer);
@@ -36,7 +39,12 @@ GLuint gen_faces(int components, int faces, GLfloat *data);
 GLuint make_shader(GLenum type, const char *source);
 GLuint load_shader(GLenum type, const char *path);
 GLuint make_program(GLuint shader1, GLuint shader2);
+GLuint make_program_like(GLuint shader1, GLuint shader2, GLuint like);
 GLuint load_program(const char *path1, const char *path2);
+GLuint load_program_defines(
+    const char *path1, const char *path2, const char *defines, GLuint like);
+void flip_image_vertical(
+    unsigned char *data, unsigned int width, unsigned int height);
 void load_png_texture(const char *file_name);
 char *tokenize(char *str, const char *delim, char **key);
 int char_width(char input);
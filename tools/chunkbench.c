@@ -0,0 +1,227 @@
+/* Measures chunk payload codecs: compression ratio and decode throughput.
+ *
+ *     chunkbench [-n COUNT] [-t] [FILE ...]
+ *
+ * Each FILE is either a capture recorded with craft --record, or raw
+ * chunks, CHUNK_SIZE^3 bytes each, back to back. With no files, COUNT
+ * chunks of generated terrain are used instead. -t prints a dictionary
+ * trained on the chunks, in the form of src/chunkdict.c. */
+
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "client.h"
+#include "codec.h"
+#include "config.h"
+#include "lz.h"
+#include "world.h"
+
+#define VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+#define DICT_SIZE 4096
+#define MIN_SECONDS 0.5
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* reads the next chunk from a capture, decoding it with the codec
+ * negotiated in it */
+static int read_captured_chunk(FILE *file, int *codec, unsigned char *ws) {
+    static unsigned char message[2 * VOLUME + 1];
+    unsigned int header[2];
+    while (fread(header, sizeof(header), 1, file) == 1) {
+        unsigned int size = ntohl(header[1]);
+        if (size > 2 * VOLUME || fread(message, 1, size, file) != size) {
+            return 0;
+        }
+        message[size] = '\0';
+        char name[16];
+        if (sscanf((char *)message, "Z,%15s", name) == 1 && codec_find(name) >= 0) {
+            *codec = codec_find(name);
+        }
+        if (message[0] == 'C' && size > 25 &&
+            codec_decompress(*codec, ws, VOLUME, message + 25, size - 25) == VOLUME)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned char *load_chunks(int argc, char **argv, int count, int *result) {
+    unsigned char *data = 0;
+    int total = 0;
+    for (int i = 0; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (!file) {
+            perror(argv[i]);
+            exit(1);
+        }
+        char magic[CAPTURE_MAGIC_SIZE];
+        int captured =
+            fread(magic, 1, CAPTURE_MAGIC_SIZE, file) == CAPTURE_MAGIC_SIZE &&
+            memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) == 0;
+        int codec = CODEC_ZLIB;
+        if (!captured) {
+            rewind(file);
+        }
+        unsigned char ws[VOLUME];
+        while (captured ? read_captured_chunk(file, &codec, ws) :
+            fread(ws, 1, VOLUME, file) == VOLUME)
+        {
+            data = realloc(data, (size_t)(total + 1) * VOLUME);
+            memcpy(data + (size_t)total * VOLUME, ws, VOLUME);
+            total++;
+        }
+        fclose(file);
+    }
+    if (!argc) {
+        int side = ceil(sqrt(count / 3.0));
+        data = malloc((size_t)count * VOLUME);
+        for (total = 0; total < count; total++) {
+            int p = total % side;
+            int r = total / side % side;
+            int q = total / (side * side);
+            world_generate(data + (size_t)total * VOLUME, p, q, r);
+        }
+    }
+    *result = total;
+    return data;
+}
+
+typedef struct {
+    unsigned char row[CHUNK_SIZE];
+    int count;
+} Row;
+
+static int compare_rows(const void *a, const void *b) {
+    return ((const Row *)a)->count - ((const Row *)b)->count;
+}
+
+/* the most common rows of blocks, most common last so they sit at the
+ * shortest offsets from the data */
+static void train(unsigned char *data, int count) {
+    int mask = 0xffff;
+    Row *rows = calloc(mask + 1, sizeof(Row));
+    int rows_used = 0;
+    for (size_t i = 0; i < (size_t)count * VOLUME; i += CHUNK_SIZE) {
+        unsigned char *row = data + i;
+        unsigned int h = 2166136261u;
+        for (int j = 0; j < CHUNK_SIZE; j++) {
+            h = (h ^ row[j]) * 16777619u;
+        }
+        for (int j = h & mask;; j = (j + 1) & mask) {
+            if (!rows[j].count) {
+                if (rows_used * 2 > mask) break;
+                memcpy(rows[j].row, row, CHUNK_SIZE);
+                rows[j].count = 1;
+                rows_used++;
+                break;
+            }
+            if (!memcmp(rows[j].row, row, CHUNK_SIZE)) {
+                rows[j].count++;
+                break;
+            }
+        }
+    }
+    qsort(rows, mask + 1, sizeof(Row), compare_rows);
+    int n = DICT_SIZE / CHUNK_SIZE;
+    printf("/* generated by tools/chunkbench -t */\n\n");
+    printf("#include \"codec.h\"\n\n");
+    printf("const unsigned char chunk_dict[] = {\n");
+    for (int i = mask + 1 - n; i <= mask; i++) {
+        for (int j = 0; j < CHUNK_SIZE; j++) {
+            printf(j % 16 ? " %d," : "    %d,", rows[i].row[j]);
+            if (j % 16 == 15) {
+                printf("\n");
+            }
+        }
+    }
+    printf("};\n\nconst int chunk_dict_size = sizeof(chunk_dict);\n");
+    free(rows);
+}
+
+static void bench(int codec, unsigned char *data, int count) {
+    int capacity = LZ_BOUND(VOLUME) + 1024;
+    unsigned char *packed = malloc((size_t)count * capacity);
+    int *sizes = malloc(sizeof(int) * count);
+    size_t packed_total = 0;
+    double start = now();
+    for (int i = 0; i < count; i++) {
+        sizes[i] = codec_compress(
+            codec, packed + (size_t)i * capacity, capacity,
+            data + (size_t)i * VOLUME, VOLUME);
+        packed_total += sizes[i];
+    }
+    double compress_time = now() - start;
+    unsigned char *ws = malloc(VOLUME);
+    int rounds = 0;
+    start = now();
+    double elapsed;
+    do {
+        for (int i = 0; i < count; i++) {
+            int n = codec_decompress(
+                codec, ws, VOLUME, packed + (size_t)i * capacity, sizes[i]);
+            if (n != VOLUME || (!rounds && memcmp(ws, data + (size_t)i * VOLUME, VOLUME))) {
+                fprintf(stderr, "%s: chunk %d does not round-trip\n",
+                    codec_name(codec), i);
+                exit(1);
+            }
+        }
+        rounds++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    double megabytes = (double)count * VOLUME / 1e6;
+    printf("%-6s %10.1f %8.2f %12.1f %12.1f %10.0f\n",
+        codec_name(codec),
+        (double)packed_total / count,
+        (double)count * VOLUME / packed_total,
+        megabytes / compress_time,
+        megabytes * rounds / elapsed,
+        count * rounds / elapsed);
+    free(ws);
+    free(sizes);
+    free(packed);
+}
+
+int main(int argc, char **argv) {
+    int count = 512;
+    int training = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-t") == 0) {
+            training = 1;
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-n COUNT] [-t] [FILE ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    unsigned char *data = load_chunks(argc - i, argv + i, count, &count);
+    if (!count) {
+        fprintf(stderr, "no chunks\n");
+        return 1;
+    }
+    if (training) {
+        train(data, count);
+    }
+    else {
+        printf("%d chunks\n", count);
+        printf("%-6s %10s %8s %12s %12s %10s\n",
+            "codec", "bytes", "ratio", "pack MB/s", "unpack MB/s", "chunks/s");
+        for (int codec = 0; codec < CODEC_COUNT; codec++) {
+            bench(codec, data, count);
+        }
+    }
+    free(data);
+    return 0;
+}
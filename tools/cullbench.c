@@ -0,0 +1,173 @@
+/* Measures frustum culling of chunk bounds: the old test of eight corners
+ * per chunk against cull_box and the batched cull_test.
+ *
+ *     cullbench [-r RADIUS] [-v VIEWS]
+ *
+ * Every chunk within RADIUS of the origin is tested against VIEWS
+ * camera directions spread around the sphere, and all three tests must
+ * agree on every chunk. */
+
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "cull.h"
+#include "matrix.h"
+
+#define MIN_SECONDS 0.5
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* the client's test before cull.c */
+static int corners_visible(float planes[6][4], const float lo[3], const float hi[3]) {
+    float points[8][3];
+    for (int i = 0; i < 8; i++) {
+        points[i][0] = i & 1 ? hi[0] : lo[0];
+        points[i][1] = i & 4 ? hi[1] : lo[1];
+        points[i][2] = i & 2 ? hi[2] : lo[2];
+    }
+    for (int i = 0; i < 6; i++) {
+        int in = 0;
+        int out = 0;
+        for (int j = 0; j < 8; j++) {
+            float d =
+                planes[i][0] * points[j][0] +
+                planes[i][1] * points[j][1] +
+                planes[i][2] * points[j][2] +
+                planes[i][3];
+            if (d < 0) {
+                out++;
+            }
+            else {
+                in++;
+            }
+            if (in && out) {
+                break;
+            }
+        }
+        if (in == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+typedef int (*BoxTest)(float planes[6][4], const float lo[3], const float hi[3]);
+
+static void test_each(
+    BoxTest test, CullBoxes *boxes, float planes[6][4], char *result)
+{
+    for (int i = 0; i < boxes->count; i++) {
+        float lo[3] = {boxes->lo[0][i], boxes->lo[1][i], boxes->lo[2][i]};
+        float hi[3] = {boxes->hi[0][i], boxes->hi[1][i], boxes->hi[2][i]};
+        result[i] = test(planes, lo, hi);
+    }
+}
+
+/* goes through every view until MIN_SECONDS have passed, checking the
+ * first round against expected; test is used box by box, or cull_test
+ * if there is none. returns the seconds per box */
+static double bench(
+    const char *name, BoxTest test, CullBoxes *boxes,
+    float (*planes)[6][4], int views, char *expected)
+{
+    char *result = malloc(boxes->count);
+    long tested = 0;
+    long visible = 0;
+    double start = now();
+    double elapsed;
+    do {
+        for (int i = 0; i < views; i++) {
+            if (test) {
+                test_each(test, boxes, planes[i], result);
+            }
+            else {
+                cull_test(boxes, planes[i], result);
+            }
+            char *want = expected + (size_t)i * boxes->count;
+            if (!tested && memcmp(want, result, boxes->count)) {
+                fprintf(stderr, "%s: disagrees in view %d\n", name, i);
+                exit(1);
+            }
+            for (int j = 0; j < boxes->count; j++) {
+                visible += result[j];
+            }
+        }
+        tested += (long)views * boxes->count;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    printf("%-8s %10.1f %10.1f %9.1f%%\n",
+        name, elapsed * 1e9 / tested, tested / elapsed / 1e6,
+        100.0 * visible / tested);
+    free(result);
+    return elapsed / tested;
+}
+
+int main(int argc, char **argv) {
+    int radius = CHUNK_RADIUS;
+    int views = 64;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            radius = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            views = atoi(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-r RADIUS] [-v VIEWS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (radius < 1 || views < 1) {
+        fprintf(stderr, "radius and views must be positive\n");
+        return 1;
+    }
+    CullBoxes boxes = {0};
+    for (int q = -radius; q <= radius; q++) {
+        for (int p = -radius; p <= radius; p++) {
+            for (int r = -radius; r <= radius; r++) {
+                int x = p * CHUNK_SIZE - 1;
+                int y = q * CHUNK_SIZE - 1;
+                int z = r * CHUNK_SIZE - 1;
+                int d = CHUNK_SIZE + 1;
+                cull_add(&boxes, x, y, z, x + d, y + d, z + d);
+            }
+        }
+    }
+    float (*planes)[6][4] = malloc(sizeof(float) * 6 * 4 * views);
+    for (int i = 0; i < views; i++) {
+        /* a golden angle spiral, so views cover the sphere evenly */
+        float ry = asinf(1 - 2 * (i + 0.5f) / views);
+        float rx = i * 2.39996323f;
+        float matrix[16];
+        set_matrix_3d(
+            matrix, 1024, 768, 16, 16, 16, rx, ry, 65, 0, radius);
+        frustum_planes(planes[i], radius, matrix);
+    }
+    char *expected = malloc((size_t)views * boxes.count);
+    for (int i = 0; i < views; i++) {
+        test_each(corners_visible, &boxes, planes[i],
+            expected + (size_t)i * boxes.count);
+    }
+    printf("%d chunks, %d views\n", boxes.count, views);
+    printf("%-8s %10s %10s %10s\n", "test", "ns/chunk", "Mchunks/s", "visible");
+    double corners = bench(
+        "corners", corners_visible, &boxes, planes, views, expected);
+    double nearest = bench(
+        "nearest", cull_box, &boxes, planes, views, expected);
+    double batched = bench(
+        "batched", 0, &boxes, planes, views, expected);
+    printf("nearest %.1fx, batched %.1fx faster than corners\n",
+        corners / nearest, corners / batched);
+    free(expected);
+    free(planes);
+    cull_free(&boxes);
+    return 0;
+}